@@ -0,0 +1,219 @@
+/*
+  ==============================================================================
+
+    ArpBankChecks.h
+    Created: 17 Oct 2026 4:36:12pm
+
+  ==============================================================================
+*/
+
+#pragma once
+
+#include "Arpeggiator.h"
+#include <JuceHeader.h>
+
+/**
+    Checks that an ArpeggiatorBank plays exactly what independent arpeggiators with the same
+    settings play, block for block, through pattern and chord edits, reset(), turnOff(),
+    tempo changes and syncToPlayHead(). Also checks that lanes with the same pattern share
+    its compiled copy, and that the buffer sized by prepareMidiBuffer() never has to grow.
+
+    Include this header in a console application and check the result of run():
+        const auto result = ArpBankChecks::run();
+        std::cout << (result.wasOk() ? "OK" : result.getErrorMessage().toStdString()) << "\n";
+        return result.wasOk() ? 0 : 1;
+*/
+namespace ArpBankChecks
+{
+    static constexpr int numLanes = 64;
+    static constexpr double sampleRate = 44100.0;
+    static constexpr int maxBlockSize = 4096;
+    static constexpr int blockSizes[] = { 64, 512, 37, 1024, 1, 4096, 333 };
+    static constexpr int numBlockSizes = (int)(sizeof(blockSizes) / sizeof(blockSizes[0]));
+
+    static const char* const patterns[] = { "1+2-3?o+4_.v25", "[135]{123}.", "g21 _ 3 #4", "12345678",
+                                            "?", "o-1o+2 V3 3", "", "g11 g92" };
+    static constexpr int numPatterns = (int)(sizeof(patterns) / sizeof(patterns[0]));
+
+    /** The settings of lane i, applied alike to the bank's lane and to its independent twin. */
+    static void configure(Arpeggiator& arpeggiator, int i)
+    {
+        arpeggiator.setRandomSeed((juce::uint64)(7 + i));
+        arpeggiator.setPattern(patterns[i % numPatterns]);
+        arpeggiator.setSubdivision(i % Arpeggiator::numSubdivisions);
+        arpeggiator.setGate(i % 3 != 0 ? 0.7f : 1.0f);
+        arpeggiator.setStrumTime(3.0f * (float)(i % 4));
+    }
+
+    static int getMidiChannel(int lane) { return 1 + lane % 16; }
+
+    /** Returns the events of a buffer as "sample:status:data1:data2" items, for failure messages. */
+    static juce::String describe(const juce::MidiBuffer& buffer)
+    {
+        juce::StringArray events;
+        for (const auto metadata : buffer)
+        {
+            auto event = juce::String(metadata.samplePosition);
+            for (int i = 0; i < metadata.numBytes; ++i)
+                event << ":" << juce::String((int)metadata.data[i]);
+            events.add(event);
+        }
+        return events.joinIntoString(" ");
+    }
+
+    static bool isSameOutput(const juce::MidiBuffer& a, const juce::MidiBuffer& b)
+    {
+        if (a.getNumEvents() != b.getNumEvents())
+            return false;
+
+        auto other = b.begin();
+        for (const auto metadata : a)
+        {
+            const auto expected = *other;
+            ++other;
+            if (metadata.samplePosition != expected.samplePosition || metadata.numBytes != expected.numBytes
+                || std::memcmp(metadata.data, expected.data, (size_t)metadata.numBytes) != 0)
+                return false;
+        }
+        return true;
+    }
+
+    /**
+        Plays a bank and independent arpeggiators side by side and fails at the first block
+        whose output differs.
+        @param syncEveryBlock Whether both follow a host position on every block, as while
+                              the transport is playing, rather than only on reset().
+    */
+    static void checkEquivalence(bool syncEveryBlock, juce::StringArray& failures)
+    {
+        const juce::String caseName = syncEveryBlock ? "synced to the host on every block" : "free-running";
+
+        std::vector<std::unique_ptr<Arpeggiator>> independent;
+        ArpeggiatorBank bank(numLanes);
+        bank.prepareToPlay(sampleRate, maxBlockSize, 200.0);
+        for (int i = 0; i < numLanes; ++i)
+        {
+            independent.push_back(std::make_unique<Arpeggiator>());
+            configure(*independent.back(), i);
+            independent.back()->prepareToPlay(sampleRate, maxBlockSize);
+            independent.back()->setTempo(100.0 + i);
+            bank.editLane(i, [i](Arpeggiator& a) { configure(a, i); a.setTempo(100.0 + i); });
+            bank.setMidiChannel(i, getMidiChannel(i));
+        }
+
+        // Makes the same change to lanes first, first + step... of both.
+        auto edit = [&](int first, int step, auto&& change)
+        {
+            for (int i = first; i < numLanes; i += step)
+            {
+                change(*independent[(size_t)i]);
+                bank.editLane(i, change);
+            }
+        };
+
+        juce::MidiBuffer expected, actual;
+        bank.prepareMidiBuffer(actual);
+        const int allocated = actual.data.getNumAllocated();
+
+        juce::AudioPlayHead::CurrentPositionInfo position;
+        position.isPlaying = true;
+        juce::int64 numEvents = 0;
+
+        for (int block = 0; block < 3000; ++block)
+        {
+            const int numSamples = blockSizes[block % numBlockSizes];
+            expected.clear();
+            actual.clear();
+
+            if (block == 700)
+            {
+                position.ppqPosition = 3.37;
+                for (int i = 0; i < numLanes; ++i)
+                    independent[(size_t)i]->reset(expected, getMidiChannel(i), position);
+                bank.reset(actual, position);
+            }
+            if (block == 1200)
+                edit(0, 3, [](Arpeggiator& a) { a.setPattern("{12}3_"); });
+            if (block == 1300)
+                edit(6, 8, [](Arpeggiator& a) { a.setPattern("123"); });
+            if (block == 1500)
+                edit(1, 5, [](Arpeggiator& a) { a.setChord(MidiTools::Chord("Am7")); a.setChordMethod(1); });
+            if (block == 1700)
+                edit(6, 16, [](Arpeggiator& a) { a.setPattern("[135]_"); });
+            if (block == 2000)
+            {
+                for (int i = 0; i < numLanes; ++i)
+                    independent[(size_t)i]->turnOff(expected, getMidiChannel(i));
+                bank.turnOff(actual);
+            }
+            if (block == 2100)
+            {
+                for (auto& arpeggiator : independent)
+                    arpeggiator->setTempo(77.0);
+                bank.setTempo(77.0);
+            }
+            if (syncEveryBlock)
+            {
+                position.ppqPosition = block * 0.01;
+                for (auto& arpeggiator : independent)
+                    arpeggiator->syncToPlayHead(position);
+                bank.syncToPlayHead(position);
+            }
+
+            for (int i = 0; i < numLanes; ++i)
+                independent[(size_t)i]->processBlock(expected, numSamples, getMidiChannel(i));
+            bank.processBlock(actual, numSamples);
+            numEvents += actual.getNumEvents();
+
+            if (! isSameOutput(expected, actual))
+            {
+                failures.add(caseName + ", block " + juce::String(block) + ": expected\n  " + describe(expected)
+                             + "\nbut the bank played\n  " + describe(actual));
+                return;
+            }
+            if (actual.data.getNumAllocated() != allocated)
+            {
+                failures.add(caseName + ", block " + juce::String(block) + ": the buffer from prepareMidiBuffer() had to grow");
+                return;
+            }
+        }
+
+        if (numEvents == 0)
+            failures.add(caseName + ": nothing was played");
+    }
+
+    /** Lanes given the same pattern string hold one compiled copy of it, released once unused. */
+    static void checkSharedPatterns(juce::StringArray& failures)
+    {
+        ArpeggiatorBank bank(256);
+        bank.prepareToPlay(sampleRate, 512);
+        for (int i = 0; i < bank.getNumLanes(); ++i)
+            bank.editLane(i, [i](Arpeggiator& a) { a.setPattern(i % 2 == 0 ? "1+2-3?o+4_.v25" : "[135]{123}."); });
+
+        // Picks up the edits, handing back the default pattern the lanes were built with.
+        juce::MidiBuffer buffer;
+        bank.prepareMidiBuffer(buffer);
+        bank.processBlock(buffer, 512);
+        for (int i = 0; i < bank.getNumLanes(); ++i)
+            bank.editLane(i, [](Arpeggiator& a) { a.setPlayNoteOffMode("Next"); }); // Publishing releases what the audio thread retired.
+
+        if (bank.getNumPatterns() != 2)
+            failures.add("256 lanes playing two patterns hold " + juce::String(bank.getNumPatterns()) + " compiled patterns");
+    }
+
+    /**
+        Runs every check.
+        @return juce::Result::ok(), or a failure describing the first block that differs in each case.
+    */
+    static juce::Result run()
+    {
+        juce::StringArray failures;
+        checkEquivalence(false, failures);
+        checkEquivalence(true, failures);
+        checkSharedPatterns(failures);
+
+        if (failures.isEmpty())
+            return juce::Result::ok();
+        return juce::Result::fail(juce::String(failures.size()) + " failure(s):\n" + failures.joinIntoString("\n"));
+    }
+}
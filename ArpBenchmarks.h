@@ -0,0 +1,375 @@
+/*
+  ==============================================================================
+
+    ArpBenchmarks.h
+    Created: 16 Oct 2026 10:12:40am
+
+  ==============================================================================
+*/
+
+#pragma once
+
+#include "Arpeggiator.h"
+#include "MidiTools.h"
+#include <JuceHeader.h>
+
+/**
+    Microbenchmarks for the Arpeggiator and MidiTools hot paths.
+
+    Include this header in a console application and print the result of run():
+        std::cout << ArpBenchmarks::run().toStdString();
+    Build it in release mode. The output is one JSON object holding a "benchmarks" array;
+    each entry has a "name", the parameters of the case, and "nsPerOp". Keep the output
+    of a run as a baseline and compare later runs against it.
+*/
+namespace ArpBenchmarks
+{
+    /**
+        Returns the average duration of one call to operation, in nanoseconds.
+        Calls it in doubling batches until at least minSeconds have elapsed.
+    */
+    template <typename Function>
+    static double measureNanoseconds(Function&& operation, double minSeconds)
+    {
+        operation(); // Warm up caches and lazily built tables.
+
+        const auto start = juce::Time::getHighResolutionTicks();
+        const auto minTicks = (juce::int64)(minSeconds * (double)juce::Time::getHighResolutionTicksPerSecond());
+        juce::int64 calls = 0, batch = 1, elapsed = 0;
+
+        while (elapsed < minTicks)
+        {
+            for (juce::int64 i = 0; i < batch; ++i)
+                operation();
+            calls += batch;
+            batch = juce::jmin(batch * 2, (juce::int64)1 << 20);
+            elapsed = juce::Time::getHighResolutionTicks() - start;
+        }
+
+        return (double)elapsed * 1.0e9 / (double)juce::Time::getHighResolutionTicksPerSecond() / (double)calls;
+    }
+
+    /** Builds a deterministic pattern of the given length mixing every kind of step. */
+    static juce::String makePattern(int length)
+    {
+        static const char* const tokens[] = { "1", "+", "2", "-", "3", "?", "o+4", "_", ".", "v25", "[135]", "=", "O-6", "#2", "g21", "O+7" };
+        juce::String pattern;
+        for (int i = 0; pattern.length() < length; ++i)
+            pattern += tokens[i % (int)(sizeof(tokens) / sizeof(tokens[0]))];
+        return pattern.substring(0, length);
+    }
+
+    /** Collects results as JSON. */
+    class Report
+    {
+    public:
+        void add(const juce::String& name, const juce::String& parameters, double nsPerOp)
+        {
+            if (entries.isNotEmpty())
+                entries << ",\n";
+            entries << "    { \"name\": \"" << name << "\"" << (parameters.isEmpty() ? "" : ", ") << parameters
+                    << ", \"nsPerOp\": " << juce::String(nsPerOp, 2) << " }";
+        }
+
+        juce::String toJson(juce::int64 checksum) const
+        {
+            return "{\n  \"checksum\": " + juce::String(checksum) + ",\n  \"benchmarks\": [\n" + entries + "\n  ]\n}\n";
+        }
+
+    private:
+        juce::String entries;
+    };
+
+    /** processBlock() per block, across block sizes, subdivisions and pattern lengths. */
+    static void benchmarkProcessBlock(Report& report, juce::int64& checksum, double minSeconds)
+    {
+        for (int patternLength : { 4, 16, 64, 512 })
+        {
+            for (int subdivision = 0; subdivision < Arpeggiator::numSubdivisions; ++subdivision)
+            {
+                for (int blockSize : { 1, 16, 64, 256, 512, 1024, 4096 })
+                {
+                    Arpeggiator arp(MidiTools::Chord("Am7"), makePattern(patternLength), 4);
+                    arp.setRandomSeed(1);
+                    arp.prepareToPlay(48000.0, blockSize);
+                    arp.setTempo(120.0);
+                    arp.setSubdivision(subdivision);
+
+                    juce::MidiBuffer buffer;
+                    arp.prepareMidiBuffer(buffer);
+
+                    const double ns = measureNanoseconds([&]
+                    {
+                        buffer.clear();
+                        arp.processBlock(buffer, blockSize);
+                        checksum += buffer.getNumEvents();
+                    }, minSeconds);
+
+                    report.add("processBlock",
+                               "\"blockSize\": " + juce::String(blockSize)
+                                 + ", \"subdivision\": " + juce::String(subdivision)
+                                 + ", \"patternLength\": " + juce::String(patternLength)
+                                 + ", \"nsPerSample\": " + juce::String(ns / blockSize, 3),
+                               ns);
+                }
+            }
+        }
+    }
+
+    /**
+        One step per call: processSteps() on a one-sample block with a step at its start, i.e.
+        getNext() plus the per-block bookkeeping around it.
+    */
+    static void benchmarkStep(Report& report, juce::int64& checksum, double minSeconds)
+    {
+        for (int patternLength : { 4, 16, 64, 512 })
+        {
+            Arpeggiator arp(MidiTools::Chord("Am7"), makePattern(patternLength), 4);
+            arp.setRandomSeed(1);
+            arp.prepareToPlay(48000.0, 1);
+
+            juce::MidiBuffer buffer;
+            arp.prepareMidiBuffer(buffer);
+            const int stepOffset = 0;
+
+            const double ns = measureNanoseconds([&]
+            {
+                buffer.clear();
+                arp.processSteps(buffer, 1, &stepOffset, 1);
+                checksum += buffer.getNumEvents();
+            }, minSeconds);
+
+            report.add("step", "\"patternLength\": " + juce::String(patternLength), ns);
+        }
+    }
+
+    /** Per lane and block: ArpeggiatorBank against the same number of independent arpeggiators. */
+    static void benchmarkBank(Report& report, juce::int64& checksum, double minSeconds)
+    {
+        constexpr int numLanes = 256;
+        constexpr int blockSize = 256;
+
+        ArpeggiatorBank bank(numLanes);
+        juce::OwnedArray<Arpeggiator> independent;
+        for (int i = 0; i < numLanes; ++i)
+        {
+            auto configure = [i](Arpeggiator& arp)
+            {
+                arp.setPattern(makePattern(16));
+                arp.setSubdivision(i % Arpeggiator::numSubdivisions);
+                arp.prepareToPlay(48000.0, blockSize);
+            };
+            bank.editLane(i, configure);
+            configure(*independent.add(new Arpeggiator()));
+        }
+
+        juce::MidiBuffer buffer;
+        bank.prepareMidiBuffer(buffer);
+
+        const double bankNs = measureNanoseconds([&]
+        {
+            buffer.clear();
+            bank.processBlock(buffer, blockSize);
+            checksum += buffer.getNumEvents();
+        }, minSeconds);
+
+        const double independentNs = measureNanoseconds([&]
+        {
+            buffer.clear();
+            for (auto* arp : independent)
+                arp->processBlock(buffer, blockSize);
+            checksum += buffer.getNumEvents();
+        }, minSeconds);
+
+        const juce::String parameters = "\"lanes\": " + juce::String(numLanes) + ", \"blockSize\": " + juce::String(blockSize);
+        report.add("bankPerLane", parameters, bankNs / numLanes);
+        report.add("independentPerLane", parameters, independentNs / numLanes);
+    }
+
+    /** One three-minute song at 1/16, 120 BPM, rendered to a MIDI file in memory. */
+    static void benchmarkRender(Report& report, juce::int64& checksum, double minSeconds)
+    {
+        static const char* const progression[] = { "CM", "Am7", "F", "G7" };
+        juce::Array<ArpeggiatorRenderer::ChordSpan> timeline;
+        for (int i = 0; i < 90; ++i)
+            timeline.add({ MidiTools::Chord(progression[i % 4]).getValue(), i * 4.0, 4.0 });
+
+        ArpeggiatorRenderer renderer;
+        renderer.getArpeggiator().setPattern(makePattern(16));
+        renderer.getArpeggiator().setRandomSeed(1);
+        juce::MemoryOutputStream out;
+
+        const double ns = measureNanoseconds([&]
+        {
+            out.reset();
+            renderer.render(timeline, 120.0, out);
+            checksum += (juce::int64)out.getDataSize();
+        }, minSeconds);
+
+        report.add("renderSong", "\"steps\": 1440", ns);
+    }
+
+    /** ChordTimelineAnalyser over a rendered three-minute song, per note-on, for both slicings. */
+    static void benchmarkChordTimeline(Report& report, juce::int64& checksum, double minSeconds)
+    {
+        static const char* const progression[] = { "CM", "Am7", "F", "G7" };
+        juce::Array<ArpeggiatorRenderer::ChordSpan> timeline;
+        for (int i = 0; i < 90; ++i)
+            timeline.add({ MidiTools::Chord(progression[i % 4]).getValue(), i * 4.0, 4.0 });
+
+        ArpeggiatorRenderer renderer;
+        renderer.getArpeggiator().setPattern("[135]_+-");
+        juce::MemoryOutputStream file;
+        renderer.render(timeline, 120.0, file);
+
+        for (auto slicing : { MidiTools::ChordTimelineAnalyser::Slicing::beats, MidiTools::ChordTimelineAnalyser::Slicing::onsets })
+        {
+            MidiTools::ChordTimelineAnalyser::Options options;
+            options.slicing = slicing;
+            MidiTools::ChordTimelineAnalyser analyser(options);
+            analyser.analyse(file.getData(), file.getDataSize());
+            const int numNoteOns = juce::jmax(1, analyser.getNumNoteOns());
+
+            const double ns = measureNanoseconds([&]
+            {
+                analyser.analyse(file.getData(), file.getDataSize());
+                checksum += analyser.getTimeline().size();
+            }, minSeconds);
+
+            report.add("chordTimelinePerNote",
+                       juce::String("\"slicing\": \"") + (slicing == MidiTools::ChordTimelineAnalyser::Slicing::beats ? "beats" : "onsets") + "\"",
+                       ns / numNoteOns);
+        }
+    }
+
+    /** Chord construction from every suffix in MidiTools::chordQualities. */
+    static void benchmarkChords(Report& report, juce::int64& checksum, double minSeconds)
+    {
+        for (int q = 0; q < MidiTools::numChordQualities; ++q)
+        {
+            const juce::String suffix(MidiTools::chordQualities[q].suffix);
+            const juce::String name = "F#" + suffix;
+
+            const double ns = measureNanoseconds([&]
+            {
+                MidiTools::Chord chord(name);
+                checksum += chord.getDegree(0);
+            }, minSeconds);
+
+            report.add("Chord", "\"suffix\": \"" + suffix + "\"", ns);
+        }
+    }
+
+    /** isChordEqual(), getNoteNumber(), getNoteName(), ScaleDetector, euclidianRythm() and euclideanMask(). */
+    static void benchmarkMidiTools(Report& report, juce::int64& checksum, double minSeconds)
+    {
+        const juce::Array<int> heldNotes { 57, 60, 64, 67 };
+        const auto target = MidiTools::PitchClassSet::fromNotes(heldNotes);
+
+        report.add("isChordEqual", "\"target\": \"string\"", measureNanoseconds([&]
+        {
+            checksum += MidiTools::isChordEqual(heldNotes, juce::String("Am7")) ? 1 : 0;
+        }, minSeconds));
+
+        report.add("isChordEqual", "\"target\": \"PitchClassSet\"", measureNanoseconds([&]
+        {
+            checksum += MidiTools::isChordEqual(heldNotes, target) ? 1 : 0;
+        }, minSeconds));
+
+        const juce::StringArray noteNames { "C4", "F#3", "Bb5", "E-1", "G#9", "Db2" };
+        int nameIndex = 0;
+        report.add("getNoteNumber", {}, measureNanoseconds([&]
+        {
+            checksum += MidiTools::getNoteNumber(noteNames[nameIndex]);
+            nameIndex = (nameIndex + 1) % noteNames.size();
+        }, minSeconds));
+
+        int noteNumber = 0;
+        report.add("getNoteName", {}, measureNanoseconds([&]
+        {
+            checksum += MidiTools::getNoteName(noteNumber).length();
+            noteNumber = (noteNumber + 1) & 127;
+        }, minSeconds));
+
+        MidiTools::ScaleDetector detector;
+        for (int note : { 60, 64, 67, 71 })
+            detector.noteOn(note);
+        report.add("ScaleDetector::advance", {}, measureNanoseconds([&]
+        {
+            detector.advance(512.0 / 48000.0);
+            checksum += detector.getMatch().root;
+        }, minSeconds));
+
+        for (int steps : { 8, 16, 64 })
+        {
+            report.add("euclidianRythm", "\"steps\": " + juce::String(steps), measureNanoseconds([&]
+            {
+                checksum += MidiTools::euclidianRythm(steps * 5 / 8, steps, 3).size();
+            }, minSeconds));
+
+            report.add("euclideanMask", "\"steps\": " + juce::String(steps), measureNanoseconds([&]
+            {
+                checksum += (juce::int64)(MidiTools::euclideanMask(steps * 5 / 8, steps, 3) & 0xff);
+            }, minSeconds));
+        }
+    }
+
+    /** RhythmIndex::findNearest() over a library of Euclidean and pseudo-random rhythms. */
+    static void benchmarkRhythmIndex(Report& report, juce::int64& checksum, double minSeconds)
+    {
+        constexpr int numRhythms = 1 << 18;
+
+        MidiTools::RhythmIndex index;
+        index.reserve(numRhythms);
+        juce::Random random(1);
+        for (int i = 0; i < numRhythms; ++i)
+        {
+            const int steps = 1 + (i & 63);
+            const auto stepsMask = MidiTools::getStepsMask(steps);
+            if (i % 4 == 0)
+            {
+                index.add({ MidiTools::euclideanMask((i >> 6) % (steps + 1), steps, (i >> 12) % steps), 0, steps });
+            }
+            else
+            {
+                const auto hits = (juce::uint64)random.nextInt64() & stepsMask;
+                index.add({ hits, (juce::uint64)random.nextInt64() & (juce::uint64)random.nextInt64() & stepsMask & ~hits, steps });
+            }
+        }
+
+        const auto query = Arpeggiator::getRhythmMasks(makePattern(16));
+        for (auto metric : { MidiTools::RhythmIndex::Metric::hamming, MidiTools::RhythmIndex::Metric::rotation })
+        {
+            const double ns = measureNanoseconds([&]
+            {
+                checksum += index.findNearest(query, 10, metric).getFirst().index;
+            }, minSeconds);
+
+            report.add("rhythmNearest",
+                       "\"rhythms\": " + juce::String(numRhythms) + ", \"k\": 10, \"metric\": \""
+                         + (metric == MidiTools::RhythmIndex::Metric::hamming ? "hamming" : "rotation") + "\"",
+                       ns);
+        }
+    }
+
+    /**
+        Runs every benchmark and returns the results as JSON.
+        @param minSecondsPerCase The minimum time spent measuring each case.
+    */
+    static juce::String run(double minSecondsPerCase = 0.02)
+    {
+        Report report;
+        juce::int64 checksum = 0; // Printed so that no measured work can be optimised away.
+
+        benchmarkProcessBlock(report, checksum, minSecondsPerCase);
+        benchmarkStep(report, checksum, minSecondsPerCase);
+        benchmarkBank(report, checksum, minSecondsPerCase);
+        benchmarkRender(report, checksum, minSecondsPerCase);
+        benchmarkChords(report, checksum, minSecondsPerCase);
+        benchmarkChordTimeline(report, checksum, minSecondsPerCase);
+        benchmarkMidiTools(report, checksum, minSecondsPerCase);
+        benchmarkRhythmIndex(report, checksum, minSecondsPerCase);
+
+        return report.toJson(checksum);
+    }
+}
@@ -0,0 +1,268 @@
+/*
+  ==============================================================================
+
+    ArpPatternChecks.h
+    Created: 17 Oct 2026 9:21:05am
+
+  ==============================================================================
+*/
+
+#pragma once
+
+#include "Arpeggiator.h"
+#include <JuceHeader.h>
+
+/**
+    Checks that any pattern string, however malformed, plays with a bounded cost per step.
+
+    Include this header in a console application built in release mode and check the result of run():
+        const auto result = ArpPatternChecks::run();
+        std::cout << (result.wasOk() ? "OK" : result.getErrorMessage().toStdString()) << "\n";
+        return result.wasOk() ? 0 : 1;
+    Every step of prefix-only patterns ("##", "bb", "o+o-"...), of maximum-length patterns and
+    of random patterns is played on its own and must finish within the step budget and stay
+    within the events that prepareMidiBuffer() sizes for. validatePattern(), the length of
+    gated notes and the neutrality of non-ASCII characters are checked too.
+
+    run() defaults to a million random patterns, a run of a few seconds to a minute
+    depending on the machine: make a full run part of every release.
+*/
+namespace ArpPatternChecks
+{
+    /** Collects failures, keeping the first ones in full. */
+    class Report
+    {
+    public:
+        void fail(const juce::String& message)
+        {
+            if (++numFailures <= 20)
+                messages.add(message);
+        }
+
+        juce::Result getResult() const
+        {
+            if (numFailures == 0)
+                return juce::Result::ok();
+            return juce::Result::fail(juce::String(numFailures) + " failure(s):\n" + messages.joinIntoString("\n"));
+        }
+
+    private:
+        juce::StringArray messages;
+        int numFailures = 0;
+    };
+
+    /**
+        Returns a random pattern mixing every command, prefix and bracket, valid or not, and
+        now and then a non-ASCII character whose low byte is a command (U+0131, U+012B).
+    */
+    static juce::String makeRandomPattern(juce::Random& random, int length)
+    {
+        static const char alphabet[] = "0123456789+-?\"=._ #bvVoOg[]{}*x";
+        juce::String pattern;
+        pattern.preallocateBytes((size_t)length);
+        for (int i = 0; i < length; ++i)
+        {
+            const int index = random.nextInt((int)sizeof(alphabet) + 1);
+            const auto c = index < (int)sizeof(alphabet) - 1 ? (juce::juce_wchar)alphabet[index]
+                                                               : (juce::juce_wchar)(index % 2 == 0 ? 0x131 : 0x12b);
+            pattern += juce::String::charToString(c);
+        }
+        return pattern;
+    }
+
+    /**
+        Plays numSteps steps of a pattern, one step per call, failing on any step producing
+        more events than the buffer is sized for, or slower than budgetTicks. A pattern is
+        only reported as slow when it is again slow on two fresh runs, so that a preempted
+        thread does not fail the check.
+    */
+    static void playSteps(const juce::String& pattern, int numSteps, juce::int64 budgetTicks, const juce::String& name, Report& report, int seed = 1)
+    {
+        constexpr size_t bytesPerEvent = sizeof(juce::int32) + sizeof(juce::uint16) + 3;
+        const int stepOffset = 0;
+        juce::String slowStep;
+
+        for (int attempt = 0; attempt < 3; ++attempt)
+        {
+            Arpeggiator arp(MidiTools::Chord("Am7"), pattern, 4);
+            arp.setRandomSeed(seed);
+            arp.prepareToPlay(48000.0, 1);
+            juce::MidiBuffer buffer;
+            arp.prepareMidiBuffer(buffer);
+            const int maxEventsPerStep = (int)(arp.getMaxMidiBytesPerBlock() / bytesPerEvent);
+            slowStep.clear();
+
+            for (int step = 0; step < numSteps; ++step)
+            {
+                buffer.clear();
+                const auto start = juce::Time::getHighResolutionTicks();
+                arp.processSteps(buffer, 1, &stepOffset, 1);
+                const auto elapsed = juce::Time::getHighResolutionTicks() - start;
+
+                if (elapsed > budgetTicks && slowStep.isEmpty())
+                    slowStep = "step " + juce::String(step) + " took "
+                             + juce::String((double)elapsed * 1.0e6 / (double)juce::Time::getHighResolutionTicksPerSecond(), 1) + " us";
+                if (attempt == 0 && buffer.getNumEvents() > maxEventsPerStep)
+                    report.fail("\"" + name + "\": step " + juce::String(step) + " produced " + juce::String(buffer.getNumEvents()) + " events");
+            }
+
+            if (slowStep.isEmpty())
+                return;
+        }
+        report.fail("\"" + name + "\": " + slowStep);
+    }
+
+    /** Patterns made only of prefixes, which once made getNext() spin forever. */
+    static void checkPrefixOnlyPatterns(Report& report, juce::int64 budgetTicks)
+    {
+        for (const char* pattern : { "##", "bb", "o+o-", "O+O-", "#b#b", "oooooooo", "v1v2v3", "V5", "g2g3", "o", "v", "g" })
+        {
+            if (Arpeggiator::validatePattern(pattern).wasOk())
+                report.fail("validatePattern() accepts \"" + juce::String(pattern) + "\"");
+
+            playSteps(pattern, 1000, budgetTicks, pattern, report);
+        }
+    }
+
+    /** Patterns of exactly maxPatternLength characters, and longer ones that get truncated. */
+    static void checkMaximumLength(Report& report, juce::int64 budgetTicks)
+    {
+        static const char* const tokens[] = { "1", "+", "[135]", "_", ".", "o+4", "{246}", "v25", "?", "g3-", "#2", "=" };
+        juce::String pattern;
+        for (int i = 0; pattern.length() < Arpeggiator::maxPatternLength; ++i)
+            pattern += tokens[i % (int)(sizeof(tokens) / sizeof(tokens[0]))];
+
+        // Cut after a complete token so that the maximum-length pattern is valid.
+        pattern = pattern.substring(0, Arpeggiator::maxPatternLength);
+        while (Arpeggiator::validatePattern(pattern).failed() && pattern.isNotEmpty())
+            pattern = pattern.dropLastCharacters(1) + "1";
+        if (pattern.length() != Arpeggiator::maxPatternLength)
+            report.fail("could not build a valid pattern of maxPatternLength characters");
+
+        if (Arpeggiator::validatePattern(pattern + "1").wasOk())
+            report.fail("validatePattern() accepts a pattern longer than maxPatternLength");
+
+        for (const auto& candidate : { pattern, pattern + pattern, juce::String::repeatedString("#", Arpeggiator::maxPatternLength * 2) })
+        {
+            playSteps(candidate, 2 * Arpeggiator::maxPatternLength, budgetTicks, "maximum length, " + juce::String(candidate.length()) + " characters", report);
+        }
+    }
+
+    /** Random patterns, mostly short and occasionally beyond maxPatternLength. */
+    static void checkRandomPatterns(Report& report, int numPatterns, juce::int64 budgetTicks)
+    {
+        juce::Random random(1);
+        for (int i = 0; i < numPatterns; ++i)
+        {
+            const int length = (i % 100 == 0) ? Arpeggiator::maxPatternLength + random.nextInt(100) : 1 + random.nextInt(64);
+            const auto pattern = makeRandomPattern(random, length);
+
+            // Must not throw or hang, whatever it returns.
+            Arpeggiator::validatePattern(pattern);
+
+            playSteps(pattern, 64, budgetTicks, pattern.substring(0, 40), report, i);
+        }
+    }
+
+    /** Returns the notes started by each of numSteps steps, e.g. "57 60|64|..." */
+    static juce::String describeSteps(const juce::String& pattern, int numSteps)
+    {
+        Arpeggiator arp(MidiTools::Chord("Am7"), pattern, 4);
+        arp.prepareToPlay(48000.0, 1);
+        juce::MidiBuffer buffer;
+        arp.prepareMidiBuffer(buffer);
+
+        const int stepOffset = 0;
+        juce::String steps;
+        for (int step = 0; step < numSteps; ++step)
+        {
+            buffer.clear();
+            arp.processSteps(buffer, 1, &stepOffset, 1);
+            for (const auto metadata : buffer)
+                if (metadata.getMessage().isNoteOn())
+                    steps += juce::String(metadata.getMessage().getNoteNumber()) + " ";
+            steps += "|";
+        }
+        return steps;
+    }
+
+    /**
+        Characters beyond ASCII are neutral, like spaces, even when their low byte is a
+        command: U+0131 must not play as '1', nor U+012B as '+'.
+    */
+    static void checkNonAsciiCharacters(Report& report)
+    {
+        // UTF-8 for U+0131, U+012B, U+0133, U+015F, U+0176, U+015B, whose low bytes are "1+3_v[".
+        for (const char* character : { "\xc4\xb1", "\xc4\xab", "\xc4\xb3", "\xc5\x9f", "\xc5\xb6", "\xc5\x9b" })
+        {
+            const auto pattern = "1" + juce::String::fromUTF8(character) + "2";
+            if (describeSteps(pattern, 12) != describeSteps("1 2", 12))
+                report.fail("\"" + pattern + "\" does not play as \"1 2\"");
+
+            if (Arpeggiator::validatePattern(juce::String::fromUTF8(character)).wasOk())
+                report.fail("validatePattern() accepts \"" + juce::String::fromUTF8(character) + "\", which plays nothing");
+        }
+    }
+
+    /** Gated notes last their gate plus one step per following '_': "g21_" lasts 1.5 steps. */
+    static void checkGates(Report& report)
+    {
+        struct GateCase { const char* pattern; float globalGate; double expectedSteps; };
+        static const GateCase cases[] = { { "g21....", 1.0f, 0.5 }, { "g21_...", 1.0f, 1.5 }, { "g61_...", 1.0f, 2.5 },
+                                          { "g11__..", 1.0f, 2.25 }, { "1__....", 0.5f, 2.5 }, { "1......", 1.5f, 1.5 } };
+        const int blockSize = 512;
+        const double samplesPerStep = 24000.0; // A quarter note at 120 BPM and 48 kHz.
+
+        for (const auto& gateCase : cases)
+        {
+            Arpeggiator arp(MidiTools::Chord("C"), gateCase.pattern, 4);
+            arp.prepareToPlay(48000.0, blockSize);
+            arp.setTempo(120.0);
+            arp.setSubdivision(0);
+            arp.setGate(gateCase.globalGate);
+            juce::MidiBuffer buffer;
+            arp.prepareMidiBuffer(buffer);
+
+            juce::int64 noteOn = -1, noteOff = -1;
+            for (juce::int64 blockStart = 0; noteOff < 0 && blockStart < (juce::int64)(6 * samplesPerStep); blockStart += blockSize)
+            {
+                buffer.clear();
+                arp.processBlock(buffer, blockSize);
+                for (const auto metadata : buffer)
+                {
+                    const auto message = metadata.getMessage();
+                    if (message.isNoteOn() && noteOn < 0)
+                        noteOn = blockStart + metadata.samplePosition;
+                    else if (message.isNoteOff() && noteOn >= 0 && noteOff < 0)
+                        noteOff = blockStart + metadata.samplePosition;
+                }
+            }
+
+            const double lengthInSteps = (double)(noteOff - noteOn) / samplesPerStep;
+            if (noteOn < 0 || noteOff < 0 || std::abs(lengthInSteps - gateCase.expectedSteps) > 1.0 / samplesPerStep)
+                report.fail("\"" + juce::String(gateCase.pattern) + "\" with gate " + juce::String(gateCase.globalGate)
+                            + ": note lasts " + juce::String(lengthInSteps) + " steps instead of " + juce::String(gateCase.expectedSteps));
+        }
+    }
+
+    /**
+        Runs every check.
+        @param numRandomPatterns         The number of random patterns, each played for 64 steps.
+                                         Run at least the default million before a release.
+        @param stepBudgetMicroseconds    The longest a single step may take.
+        @return juce::Result::ok(), or a failure listing the offending patterns and steps.
+    */
+    static juce::Result run(int numRandomPatterns = 1000000, double stepBudgetMicroseconds = 50.0)
+    {
+        Report report;
+        const auto budgetTicks = (juce::int64)(stepBudgetMicroseconds * 1.0e-6 * (double)juce::Time::getHighResolutionTicksPerSecond());
+
+        checkGates(report);
+        checkNonAsciiCharacters(report);
+        checkPrefixOnlyPatterns(report, budgetTicks);
+        checkMaximumLength(report, budgetTicks);
+        checkRandomPatterns(report, numRandomPatterns, budgetTicks);
+
+        return report.getResult();
+    }
+}
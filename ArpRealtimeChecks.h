@@ -0,0 +1,442 @@
+/*
+  ==============================================================================
+
+    ArpRealtimeChecks.h
+    Created: 17 Oct 2026 11:02:37am
+
+  ==============================================================================
+*/
+
+#pragma once
+
+#include "Arpeggiator.h"
+#include <JuceHeader.h>
+#include <atomic>
+#include <cerrno>
+#include <cstdlib>
+#include <new>
+
+#if defined(__GLIBC__)
+ #include <dlfcn.h>
+ #include <execinfo.h>
+ #include <pthread.h>
+#endif
+
+/**
+    Checks that the audio-thread entry points never allocate, free or lock.
+
+    This header replaces the global operator new and delete and, on glibc, also intercepts
+    malloc(), calloc(), realloc(), free(), the aligned allocators and pthread_mutex_lock(),
+    which std::mutex and juce::CriticalSection end up in. So include it in exactly one
+    translation unit of a console application, and nowhere in the plugin itself; on glibc
+    older than 2.34, link with -ldl. Then check the result of run():
+        const auto result = ArpRealtimeChecks::run();
+        std::cout << (result.wasOk() ? "OK" : result.getErrorMessage().toStdString()) << "\n";
+        return result.wasOk() ? 0 : 1;
+
+    The interception only counts calls made while a check is armed, and only on the thread
+    that armed it, so the rest of the program runs as usual. run() plays every combination
+    of pattern, chord method and block size, changing the chord and pattern between blocks
+    as a message thread would, and calls processBlock(), syncToPlayHead(), reset() and
+    turnOff() with buffers sized by prepareMidiBuffer(); ArpeggiatorBank likewise, and
+    ArpClock with subscriptions changing between blocks. Any violation fails, reported with
+    the number of blocks it occurred in, the most in one block and, on glibc, the call
+    stack of the first one (link with -rdynamic for names).
+*/
+namespace ArpRealtimeChecks
+{
+    /** The per-thread state of the interception. */
+    namespace detail
+    {
+        static constexpr int maxFrames = 24;
+
+        struct Violation
+        {
+            const char* what = nullptr;
+            void* frames[maxFrames] {};
+            int numFrames = 0;
+        };
+
+        inline thread_local bool armed = false;
+        inline thread_local bool recording = false; // Set while recording, so that backtrace() itself is not counted.
+        inline thread_local int numViolations = 0;
+        inline thread_local Violation firstViolation;
+
+        inline void record(const char* what) noexcept
+        {
+            if (! armed || recording)
+                return;
+
+            recording = true;
+            if (numViolations++ == 0)
+            {
+                firstViolation.what = what;
+               #if defined(__GLIBC__)
+                firstViolation.numFrames = backtrace(firstViolation.frames, maxFrames);
+               #endif
+            }
+            recording = false;
+        }
+
+       #if defined(__GLIBC__)
+        extern "C" void* __libc_malloc(size_t);
+        extern "C" void* __libc_calloc(size_t, size_t);
+        extern "C" void* __libc_realloc(void*, size_t);
+        extern "C" void* __libc_memalign(size_t, size_t);
+        extern "C" void __libc_free(void*);
+
+        inline void* rawAllocate(size_t size) noexcept { return __libc_malloc(size); }
+        inline void rawFree(void* p) noexcept          { __libc_free(p); }
+       #else
+        inline void* rawAllocate(size_t size) noexcept { return std::malloc(size); }
+        inline void rawFree(void* p) noexcept          { std::free(p); }
+       #endif
+
+        inline void* allocate(size_t size, const char* what) noexcept
+        {
+            record(what);
+            return rawAllocate(size == 0 ? 1 : size);
+        }
+
+        inline void* allocateOrThrow(size_t size, const char* what)
+        {
+            if (auto* p = allocate(size, what))
+                return p;
+            throw std::bad_alloc();
+        }
+
+        inline void deallocate(void* p, const char* what) noexcept
+        {
+            if (p == nullptr)
+                return;
+            record(what);
+            rawFree(p);
+        }
+    }
+
+    /**
+        Calls call() with the interception armed on this thread.
+        @return The number of allocations, frees and locks it made.
+    */
+    template <typename Function>
+    static int countViolations(Function&& call)
+    {
+        detail::numViolations = 0;
+        detail::armed = true;
+        call();
+        detail::armed = false;
+        return detail::numViolations;
+    }
+
+    /** Returns the call stack of the first violation counted by the last countViolations(). */
+    static juce::String getFirstViolation()
+    {
+        const auto& violation = detail::firstViolation;
+        juce::String text = violation.what != nullptr ? violation.what : "?";
+       #if defined(__GLIBC__)
+        if (char** symbols = backtrace_symbols(violation.frames, violation.numFrames))
+        {
+            for (int i = 0; i < violation.numFrames; ++i)
+                text += juce::String("\n        ") + symbols[i];
+            std::free(symbols);
+        }
+       #endif
+        return text;
+    }
+
+    /** Violations of one entry point over the blocks of one case. */
+    struct EntryPointCount
+    {
+        const char* name;
+        int numCalls = 0;
+        int numBlocks = 0;   // Blocks in which the entry point made at least one violation.
+        int maxPerBlock = 0;
+        juce::String first;
+
+        template <typename Function>
+        void check(Function&& call)
+        {
+            ++numCalls;
+            const int count = countViolations(call);
+            if (count == 0)
+                return;
+            if (numBlocks++ == 0)
+                first = getFirstViolation();
+            maxPerBlock = juce::jmax(maxPerBlock, count);
+        }
+    };
+
+    /** Collects failures, keeping the first ones in full. */
+    class Report
+    {
+    public:
+        void add(const juce::String& caseName, const EntryPointCount& count)
+        {
+            if (count.numBlocks == 0)
+                return;
+            if (++numFailures <= 20)
+                messages.add(caseName + ": " + count.name + " violated in " + juce::String(count.numBlocks)
+                             + " of " + juce::String(count.numCalls) + " blocks, at most "
+                             + juce::String(count.maxPerBlock) + " per block; first: " + count.first);
+        }
+
+        juce::Result getResult() const
+        {
+            if (numFailures == 0)
+                return juce::Result::ok();
+            return juce::Result::fail(juce::String(numFailures) + " failure(s):\n" + messages.joinIntoString("\n"));
+        }
+
+    private:
+        juce::StringArray messages;
+        int numFailures = 0;
+    };
+
+    static const char* const patterns[] = { "1", "123", "[1357]g213", "o+1_2-3.", "v2?1=3", "{135}g61_.", "#1b2O-3", "##", "1__.g21_" };
+    static const int blockSizes[] = { 1, 16, 64, 256, 512, 1024, 4096 };
+
+    /** The number of blocks played per case: at least two seconds of audio. */
+    static int getNumBlocks(int blockSize)
+    {
+        return juce::jmax(256, 2 * 48000 / blockSize);
+    }
+
+    /** Plays one pattern with one chord method and block size, checking every audio-thread call. */
+    static void checkArpeggiator(const char* pattern, int chordMethod, int blockSize, Report& report)
+    {
+        Arpeggiator arp(MidiTools::Chord("Am7"), pattern, 4);
+        arp.setChordMethod(chordMethod);
+        arp.prepareToPlay(48000.0, blockSize);
+        arp.setTempo(140.0);
+        arp.setSubdivision(6);
+        arp.setGate(1.5f);
+        arp.setStrumTime(20.0f);
+        juce::MidiBuffer buffer;
+        arp.prepareMidiBuffer(buffer);
+
+        EntryPointCount processBlock { "processBlock()" }, syncToPlayHead { "syncToPlayHead()" },
+                        reset { "reset(buffer)" }, turnOff { "turnOff(buffer)" };
+        juce::AudioPlayHead::CurrentPositionInfo position;
+        position.isPlaying = true;
+
+        const int numBlocks = getNumBlocks(blockSize);
+        for (int block = 0; block < numBlocks; ++block)
+        {
+            // Message-thread changes, picked up by the next audio-thread call.
+            if (block % 8 == 0)
+                arp.setChord(MidiTools::Chord(block % 16 == 0 ? "Dm9" : "Am7"));
+            if (block % 29 == 0)
+                arp.setPattern(block % 58 == 0 ? juce::String(pattern) + "2" : juce::String(pattern));
+
+            buffer.clear();
+            position.ppqPosition = block * blockSize / 48000.0 * 140.0 / 60.0;
+            if (block % 16 == 0)
+                syncToPlayHead.check([&] { arp.syncToPlayHead(position); });
+            if (block % 37 == 0)
+                reset.check([&] { arp.reset(buffer, 1, position); });
+            if (block % 53 == 0)
+                turnOff.check([&] { arp.turnOff(buffer, 1); });
+            processBlock.check([&] { arp.processBlock(buffer, blockSize); });
+        }
+
+        const auto caseName = "\"" + juce::String(pattern) + "\", chord method " + juce::String(chordMethod)
+                            + ", blocks of " + juce::String(blockSize);
+        for (const auto* count : { &processBlock, &syncToPlayHead, &reset, &turnOff })
+            report.add(caseName, *count);
+    }
+
+    /** The same for an ArpeggiatorBank whose lanes play every pattern. */
+    static void checkBank(int blockSize, Report& report)
+    {
+        constexpr int numPatterns = (int)(sizeof(patterns) / sizeof(patterns[0]));
+        ArpeggiatorBank bank(numPatterns);
+        for (int i = 0; i < numPatterns; ++i)
+            bank.editLane(i, [&](Arpeggiator& a) { a.setPattern(patterns[i]); a.setChordMethod(i % 3); a.setGate(0.5f); });
+        bank.prepareToPlay(48000.0, blockSize);
+        bank.setTempo(140.0);
+        juce::MidiBuffer buffer;
+        bank.prepareMidiBuffer(buffer);
+
+        EntryPointCount processBlock { "ArpeggiatorBank::processBlock()" }, syncToPlayHead { "ArpeggiatorBank::syncToPlayHead()" },
+                        reset { "ArpeggiatorBank::reset(buffer)" }, turnOff { "ArpeggiatorBank::turnOff(buffer)" };
+        juce::AudioPlayHead::CurrentPositionInfo position;
+        position.isPlaying = true;
+
+        const int numBlocks = getNumBlocks(blockSize);
+        for (int block = 0; block < numBlocks; ++block)
+        {
+            if (block % 8 == 0)
+                bank.editLane(block % numPatterns, [block](Arpeggiator& a) { a.setChord(MidiTools::Chord(block % 16 == 0 ? "Dm9" : "Am7")); });
+
+            buffer.clear();
+            position.ppqPosition = block * blockSize / 48000.0 * 140.0 / 60.0;
+            if (block % 16 == 0)
+                syncToPlayHead.check([&] { bank.syncToPlayHead(position); });
+            if (block % 37 == 0)
+                reset.check([&] { bank.reset(buffer, position); });
+            if (block % 53 == 0)
+                turnOff.check([&] { bank.turnOff(buffer); });
+            processBlock.check([&] { bank.processBlock(buffer, blockSize); });
+        }
+
+        const auto caseName = "bank, blocks of " + juce::String(blockSize);
+        for (const auto* count : { &processBlock, &syncToPlayHead, &reset, &turnOff })
+            report.add(caseName, *count);
+    }
+
+    /** The same for arpeggiators playing from an ArpClock, which subscribes and unsubscribes them between blocks. */
+    static void checkClock(int blockSize, Report& report)
+    {
+        constexpr int numPatterns = (int)(sizeof(patterns) / sizeof(patterns[0]));
+        std::vector<std::unique_ptr<Arpeggiator>> arpeggiators;
+        ArpClock clock;
+        clock.prepareToPlay(48000.0, blockSize);
+        clock.setTempo(140.0);
+        for (int i = 0; i < numPatterns; ++i)
+        {
+            arpeggiators.push_back(std::make_unique<Arpeggiator>(MidiTools::Chord("Am7"), patterns[i], 4));
+            arpeggiators.back()->prepareToPlay(48000.0, blockSize);
+            arpeggiators.back()->setSubdivision(i);
+            clock.subscribe(*arpeggiators.back(), 1 + i);
+        }
+        juce::MidiBuffer buffer;
+        clock.prepareMidiBuffer(buffer);
+
+        EntryPointCount processBlock { "ArpClock::processBlock()" }, subscribe { "ArpClock::subscribe()" },
+                        unsubscribe { "ArpClock::unsubscribe()" }, syncToPlayHead { "ArpClock::syncToPlayHead()" };
+        juce::AudioPlayHead::CurrentPositionInfo position;
+        position.isPlaying = true;
+
+        const int numBlocks = getNumBlocks(blockSize);
+        for (int block = 0; block < numBlocks; ++block)
+        {
+            auto& arpeggiator = *arpeggiators[(size_t)(block % numPatterns)];
+            buffer.clear();
+            position.ppqPosition = block * blockSize / 48000.0 * 140.0 / 60.0;
+            if (block % 16 == 0)
+                syncToPlayHead.check([&] { clock.syncToPlayHead(position); });
+            if (block % 11 == 0)
+                unsubscribe.check([&] { clock.unsubscribe(arpeggiator); });
+            if (block % 11 == 5)
+                subscribe.check([&] { clock.subscribe(arpeggiator, 1 + block % numPatterns); });
+            processBlock.check([&] { clock.processBlock(buffer, blockSize); });
+        }
+
+        const auto caseName = "clock, blocks of " + juce::String(blockSize);
+        for (const auto* count : { &processBlock, &subscribe, &unsubscribe, &syncToPlayHead })
+            report.add(caseName, *count);
+    }
+
+    /**
+        Runs every check.
+        @return juce::Result::ok(), or a failure listing the offending cases and entry points.
+    */
+    static juce::Result run()
+    {
+        // Checks that the interception works before trusting a clean result.
+        if (countViolations([] { delete new int(0); }) != 2)
+            return juce::Result::fail("operator new and delete are not intercepted");
+
+       #if defined(__GLIBC__)
+        void* frames[1];
+        backtrace(frames, 1); // Loads the unwinder now rather than while recording.
+       #endif
+
+        Report report;
+        for (const auto* pattern : patterns)
+            for (int chordMethod = 0; chordMethod < 3; ++chordMethod)
+                for (const int blockSize : blockSizes)
+                    checkArpeggiator(pattern, chordMethod, blockSize, report);
+
+        for (const int blockSize : blockSizes)
+        {
+            checkBank(blockSize, report);
+            checkClock(blockSize, report);
+        }
+
+        return report.getResult();
+    }
+}
+
+//==============================================================================
+// Replacements of the global allocation functions, counting calls while armed.
+
+void* operator new(std::size_t size)                                   { return ArpRealtimeChecks::detail::allocateOrThrow(size, "operator new"); }
+void* operator new[](std::size_t size)                                 { return ArpRealtimeChecks::detail::allocateOrThrow(size, "operator new[]"); }
+void* operator new(std::size_t size, const std::nothrow_t&) noexcept   { return ArpRealtimeChecks::detail::allocate(size, "operator new"); }
+void* operator new[](std::size_t size, const std::nothrow_t&) noexcept { return ArpRealtimeChecks::detail::allocate(size, "operator new[]"); }
+
+void operator delete(void* p) noexcept                                 { ArpRealtimeChecks::detail::deallocate(p, "operator delete"); }
+void operator delete[](void* p) noexcept                               { ArpRealtimeChecks::detail::deallocate(p, "operator delete[]"); }
+void operator delete(void* p, std::size_t) noexcept                    { ArpRealtimeChecks::detail::deallocate(p, "operator delete"); }
+void operator delete[](void* p, std::size_t) noexcept                  { ArpRealtimeChecks::detail::deallocate(p, "operator delete[]"); }
+void operator delete(void* p, const std::nothrow_t&) noexcept          { ArpRealtimeChecks::detail::deallocate(p, "operator delete"); }
+void operator delete[](void* p, const std::nothrow_t&) noexcept        { ArpRealtimeChecks::detail::deallocate(p, "operator delete[]"); }
+
+#if defined(__GLIBC__)
+// The C allocator, which the aligned operator new and most libraries use, and the mutex
+// behind std::mutex and juce::CriticalSection.
+extern "C"
+{
+    void* malloc(size_t size) noexcept
+    {
+        ArpRealtimeChecks::detail::record("malloc");
+        return ArpRealtimeChecks::detail::__libc_malloc(size);
+    }
+
+    void* calloc(size_t count, size_t size) noexcept
+    {
+        ArpRealtimeChecks::detail::record("calloc");
+        return ArpRealtimeChecks::detail::__libc_calloc(count, size);
+    }
+
+    void* realloc(void* p, size_t size) noexcept
+    {
+        ArpRealtimeChecks::detail::record("realloc");
+        return ArpRealtimeChecks::detail::__libc_realloc(p, size);
+    }
+
+    void free(void* p) noexcept
+    {
+        if (p != nullptr)
+            ArpRealtimeChecks::detail::record("free");
+        ArpRealtimeChecks::detail::__libc_free(p);
+    }
+
+    void* memalign(size_t alignment, size_t size) noexcept
+    {
+        ArpRealtimeChecks::detail::record("memalign");
+        return ArpRealtimeChecks::detail::__libc_memalign(alignment, size);
+    }
+
+    void* aligned_alloc(size_t alignment, size_t size) noexcept
+    {
+        ArpRealtimeChecks::detail::record("aligned_alloc");
+        return ArpRealtimeChecks::detail::__libc_memalign(alignment, size);
+    }
+
+    int posix_memalign(void** result, size_t alignment, size_t size) noexcept
+    {
+        ArpRealtimeChecks::detail::record("posix_memalign");
+        if (alignment % sizeof(void*) != 0 || (alignment & (alignment - 1)) != 0)
+            return EINVAL;
+        *result = ArpRealtimeChecks::detail::__libc_memalign(alignment, size);
+        return *result != nullptr ? 0 : ENOMEM;
+    }
+
+    int pthread_mutex_lock(pthread_mutex_t* mutex) noexcept
+    {
+        using LockFunction = int (*)(pthread_mutex_t*);
+        static std::atomic<LockFunction> next { nullptr }; // Constant-initialised: no guard, which would lock.
+
+        ArpRealtimeChecks::detail::record("pthread_mutex_lock");
+        auto lock = next.load(std::memory_order_acquire);
+        if (lock == nullptr)
+        {
+            lock = (LockFunction)dlsym(RTLD_NEXT, "pthread_mutex_lock");
+            next.store(lock, std::memory_order_release);
+        }
+        return lock(mutex);
+    }
+}
+#endif
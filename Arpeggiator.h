@@ -12,6 +12,13 @@
 
 #include "MidiTools.h"
 #include <JuceHeader.h>
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <limits>
+#include <map>
+#include <memory>
+#include <vector>
 
 /**
     A base class for creating MIDI arpeggiators.
@@ -29,6 +36,10 @@
     - '-': Plays the previous degree in the chord (e.g., from 2 to 1).
     - '?': Plays a random, valid note from the current chord.
     - '"' or '=': Repeats the last played degree.
+    - '[135]': Plays several degrees at once (here 1, 3 and 5). Prefixes apply to every note,
+      and '+'/'-' continue from the last degree listed.
+    - '{135}': The same chord, strummed: each note starts setStrumTime() after the previous one,
+      and the whole strum stays within the step.
     - '#' (Sharp): Pitches the next note up by one semitone. This is a local effect. Example: "#0"
     - 'b' (Flat): Pitches the next note down by one semitone. This is a local effect. Example: "b0"
 
@@ -45,6 +56,27 @@
 
     Note: Octave modifiers are prefixes. "o-o-" means "decrease octave, then decrease octave again".
     To decrease the octave and then play the previous degree, you would use "o--".
+
+    Gate Modifiers (prefixed to a note command):
+    - 'gN': Sets the gate for the next note only, in quarters of a step. N is a digit from 1-9.
+      Example: "g21" plays degree 1 for half a step. g1=25%, g4=100%, g6=150%; g0 uses the global gate.
+    - setGate() sets the gate of every other note. At 100% (the default) a note is held until the
+      next note command, as always. Any other gate schedules the note-off instead: shorter gates
+      give staccato notes without inserting rests, longer ones let notes overlap (legato).
+      Each '_' step following such a note lengthens it by one step: "g21_" lasts 1.5 steps.
+
+    Real-time cost: setPattern() compiles the pattern into one record per character, so the
+    work done for each step on the audio thread is constant whatever the pattern contains:
+    one record fetch, then one degree-table read and one voice-table update per note played.
+    Patterns that contain no reachable note command (e.g. "##", "o+o-" or only spaces) cannot
+    stall; each of their steps repeats the last played degree. Patterns are truncated to
+    maxPatternLength characters, which bounds the compile time. Use validatePattern() to
+    report such problems to the user before setting a pattern.
+
+    On the audio thread, use the overloads that take a juce::MidiBuffer& (processBlock(),
+    reset() and turnOff()) with a buffer sized by prepareMidiBuffer(), together with
+    syncToPlayHead(): none of them allocates or locks. The overloads returning a
+    juce::MidiBuffer allocate it and are meant for offline use.
 */
 class Arpeggiator
 {
@@ -54,7 +86,8 @@ public:
         Initializes with a default C Major chord, a simple pattern, and a base octave.
     */
     Arpeggiator()
-        : chord(MidiTools::Chord("CM")), pattern("012"), octave(baseOctave)
+        : chord(MidiTools::Chord("CM").getValue()), pattern("012"), compiledPattern(compileShared(pattern)),
+          publishedChord(MidiTools::Chord("CM")), publishedPattern(pattern)
     {
     }
 
@@ -65,20 +98,80 @@ public:
         @param baseOctave The starting MIDI octave.
     */
     Arpeggiator(const MidiTools::Chord& initialChord, const juce::String& arpPattern, int baseOctave)
-        : chord(initialChord), pattern(arpPattern), octave(baseOctave)
+        : chord(initialChord.getValue()), pattern(arpPattern.substring(0, maxPatternLength)), compiledPattern(compileShared(pattern)),
+          publishedChord(initialChord), publishedPattern(pattern)
     {
+        ownPlayState.octave = baseOctave;
     }
 
-    virtual ~Arpeggiator() = default;
+    virtual ~Arpeggiator()
+    {
+        delete pendingChanges.exchange(nullptr);
+        releaseRetiredChanges();
+    }
 
     /**
         Call this before playback to set the sample rate.
         @param rate The host's sample rate.
+        @param maximumBlockSize The largest block size processBlock() will be called with.
+                                Used by prepareMidiBuffer() to size output buffers.
     */
-    void prepareToPlay(double rate)
+    void prepareToPlay(double rate, int maximumBlockSize = 0)
     {
         sampleRate = rate;
+        maxBlockSize = juce::jmax(0, maximumBlockSize);
         updateSamplesPerNote();
+
+        // Builds the chord table here rather than on the first identifyChord() on the audio thread.
+        MidiTools::ChordIdentificationTable::getInstance();
+    }
+
+    /**
+        Returns the number of bytes a juce::MidiBuffer needs so that one call to
+        processBlock() with the prepared maximum block size can never make it grow.
+        Steps are at least one sample apart and each starts at most maxChordDegrees notes.
+        Every note-off belongs to a note started in the block, sounding at its start
+        (at most maxVoices) or queued before it (at most maxScheduledEvents).
+    */
+    size_t getMaxMidiBytesPerBlock() const
+    {
+        return getMaxMidiBytesForSteps(maxBlockSize);
+    }
+
+    /** Like getMaxMidiBytesPerBlock(), for a block known to hold at most maxSteps steps. */
+    static size_t getMaxMidiBytesForSteps(int maxSteps)
+    {
+        constexpr size_t bytesPerEvent = sizeof(juce::int32) + sizeof(juce::uint16) + 3;
+        const size_t notesStarted = (size_t)juce::jmax(0, maxSteps) * PatternStep::maxChordDegrees + (size_t)maxScheduledEvents;
+        return (notesStarted * 2 + (size_t)maxVoices) * bytesPerEvent;
+    }
+
+    /**
+        Returns the most steps a block of numSamples can hold in any subdivision, at tempos
+        up to maximumTempoBPM. After a step the countdown is within a sample of a whole step,
+        so steps are at least floor(samples per step) apart; the block may also start on one.
+    */
+    static int getMaxStepsPerBlock(double rate, int numSamples, double maximumTempoBPM)
+    {
+        if (rate <= 0.0 || maximumTempoBPM <= 0.0)
+            return numSamples;
+
+        double fastestDivisor = 0.0;
+        for (int i = 0; i < numSubdivisions; ++i)
+            fastestDivisor = juce::jmax(fastestDivisor, getNoteDivisor(i));
+
+        const double minSamplesPerStep = rate * 60.0 / maximumTempoBPM / fastestDivisor;
+        return juce::jmin(numSamples, numSamples / juce::jmax(1, (int)minSamplesPerStep) + 1);
+    }
+
+    /**
+        Preallocates a buffer for use with the in-place processBlock().
+        Call this from prepareToPlay(), never from the audio thread. When several
+        arpeggiators share one buffer, call it once with the summed sizes instead.
+    */
+    void prepareMidiBuffer(juce::MidiBuffer& buffer) const
+    {
+        buffer.ensureSize(getMaxMidiBytesPerBlock());
     }
 
     /**
@@ -89,16 +182,39 @@ public:
     juce::MidiBuffer processBlock(int numSamples, int midiChannel = 1)
     {
         juce::MidiBuffer generatedMidi;
-        if (sampleRate <= 0.0 || samplesPerNote <= 0.0 || pattern.isEmpty())
-            return generatedMidi;
+        processBlock(generatedMidi, numSamples, midiChannel);
+        return generatedMidi;
+    }
+
+    /**
+        Generates MIDI events for the current block of audio samples, appending them
+        to an existing buffer. This does not allocate as long as the buffer has been
+        sized with prepareMidiBuffer() and numSamples does not exceed the prepared
+        maximum block size.
+        @param midiOut    The buffer to append events to. Existing events are kept.
+        @param numSamples The number of samples in the current audio block.
+    */
+    void processBlock(juce::MidiBuffer& midiOut, int numSamples, int midiChannel = 1)
+    {
+        if (! beginBlock(midiOut, numSamples))
+            return;
         if (midiChannel < 1 || midiChannel > 16) midiChannel = 1;
 
+       #if JUCE_DEBUG
+        // If this fires, the output buffer had to grow on the audio thread:
+        // size it with prepareMidiBuffer() and keep numSamples <= maximumBlockSize.
+        const int allocatedBefore = midiOut.data.getNumAllocated();
+        const bool checkAllocation = numSamples <= maxBlockSize
+                                  && (size_t)(allocatedBefore - midiOut.data.size()) >= getMaxMidiBytesPerBlock();
+       #endif
+
         int time = 0;
         while (time < numSamples)
         {
             if (samplesUntilNextNote <= 0.0)
             {
-                generatedMidi.addEvents(getNext(midiChannel), 0, -1, time);
+                releaseDueEvents(midiOut, time); // Note-offs falling on this sample go before the note-on.
+                getNext(midiOut, time, midiChannel);
                 // Use 'while' to handle cases where the block size is larger than the note duration.
                 while (samplesUntilNextNote <= 0.0)
                     samplesUntilNextNote += samplesPerNote;
@@ -111,190 +227,306 @@ public:
             time += samplesThisStep;
             samplesUntilNextNote -= samplesThisStep;
         }
-        return generatedMidi;
+
+        releaseDueEvents(midiOut, numSamples - 1);
+        sampleTime += numSamples;
+
+       #if JUCE_DEBUG
+        jassert(! checkAllocation || midiOut.data.getNumAllocated() == allocatedBefore);
+       #endif
+    }
+
+    /**
+        Like processBlock(), but plays steps only at the given sample offsets instead of
+        running its own countdown. ArpClock uses this to drive every arpeggiator sharing a
+        subdivision from the same step boundaries; getSamplesUntilNextNote() is not updated.
+        @param stepOffsets    Sample offsets of the steps in this block, increasing and below numSamples.
+        @param numStepOffsets The number of entries in stepOffsets.
+    */
+    void processSteps(juce::MidiBuffer& midiOut, int numSamples, const int* stepOffsets, int numStepOffsets, int midiChannel = 1)
+    {
+        if (! beginBlock(midiOut, numSamples))
+            return;
+        if (midiChannel < 1 || midiChannel > 16) midiChannel = 1;
+
+        for (int i = 0; i < numStepOffsets; ++i)
+        {
+            jassert(juce::isPositiveAndBelow(stepOffsets[i], numSamples));
+            releaseDueEvents(midiOut, stepOffsets[i]); // Note-offs falling on this sample go before the note-on.
+            getNext(midiOut, stepOffsets[i], midiChannel);
+        }
+
+        releaseDueEvents(midiOut, numSamples - 1);
+        sampleTime += numSamples;
     }
 
 private:
     /**
-        Processes the next step in the arpeggio pattern and returns MIDI messages.
-        @return A juce::MidiBuffer containing note-on and/or note-off messages.
+        Picks up published changes at the start of a block.
+        @return false if nothing can play; the block's scheduled events have then been handled.
     */
-    juce::MidiBuffer getNext(int midiChannel)
+    bool beginBlock(juce::MidiBuffer& midiOut, int numSamples)
     {
-        juce::MidiBuffer midiBuffer;
-        int samplePosition = 0; // All events happen at the start of the block
+        applyPendingChanges();
+        if (degreeTableDirty.exchange(false, std::memory_order_acquire))
+            updateDegreeTable();
+        if (notesNeedRelease)
+            releaseAllNotes(midiOut, 0); // The pattern changed.
 
-        if (pattern.isEmpty())
-            return midiBuffer;
+        if (sampleRate <= 0.0 || samplesPerNote <= 0.0 || pattern.isEmpty())
+        {
+            releaseDueEvents(midiOut, numSamples - 1);
+            sampleTime += juce::jmax(0, numSamples);
+            return false;
+        }
+        return true;
+    }
 
+    /**
+        Processes the next step in the arpeggio pattern and adds its MIDI messages.
+        @param midiBuffer     The buffer receiving note-on and/or note-off messages.
+        @param samplePosition The sample offset at which the step's events are added.
+    */
+    void getNext(juce::MidiBuffer& midiBuffer, int samplePosition, int midiChannel)
+    {
+        if (pattern.isEmpty())
+            return;
 
-        // --- 2. Parse the pattern using a robust loop ---
-        int noteToPlay = -1;
-        int currentDegreeIndex = lastPlayedDegreeIndex;
-        int semitoneOffset = 0; // For local sharp/flat modifiers
-        int localVelocity = -1; // For local velocity modifier
-        int localOctave = -1;   // For local octave modifier
-        bool noteCommandFound = false;
-        bool shouldUpdateLastDegree = true;
-        
-        // This outer loop ensures we will always find a note command, even if we have to
-        // wrap around the pattern string after processing prefixes at the end.
-        for (int i = 0; i < pattern.length() * 2 && !noteCommandFound; ++i)
+        // --- 1. A rest of the Euclidean rhythm silences the step and holds the pattern back ---
+        if (rhythmSteps > 0)
         {
-            // This inner loop consumes any number of prefix commands.
-            while (true)
+            const bool isHit = ((rhythmMask >> rhythmPos) & 1) != 0;
+            rhythmPos = (rhythmPos + 1) % rhythmSteps;
+            if (! isHit)
             {
-                char command = pattern[pos];
-                
-                if (command == 'o' || command == 'O')
-                {
-                    currentStepIndex = getStepForPatternIndex(pos);
-                    pos = (pos + 1) % pattern.length(); // Consume 'o' or 'O'
-                    char octaveCommand = pattern[pos];
-                    pos = (pos + 1) % pattern.length(); // Consume octave value
-                    
-                    int currentStepOctave = (localOctave != -1) ? localOctave : octave;
-                    int targetOctave = currentStepOctave;
-                    if (octaveCommand == '+') targetOctave = juce::jmin(7, currentStepOctave + 1);
-                    else if (octaveCommand == '-') targetOctave = juce::jmax(0, currentStepOctave - 1);
-                    else if (juce::CharacterFunctions::isDigit(octaveCommand)) targetOctave = octaveCommand - '0';
-                    
-                    if (command == 'o') localOctave = targetOctave;
-                    else octave = targetOctave;
-                }
-                else if (command == 'v' || command == 'V')
-                {
-                    currentStepIndex = getStepForPatternIndex(pos);
-                    pos = (pos + 1) % pattern.length(); // Consume 'v' or 'V'
-                    char velocityValueChar = pattern[pos];
-                    pos = (pos + 1) % pattern.length(); // Consume velocity value
-                    
-                    if (juce::CharacterFunctions::isDigit(velocityValueChar))
-                    {
-                        int velocityLevel = velocityValueChar - '0';
-                        int velocity = juce::jmin(127, velocityLevel * 16);
-                        if (command == 'v') localVelocity = velocity;
-                        else globalVelocity = velocity;
-                    }
-                }
-                else if (command == '#')
-                {
-                    currentStepIndex = getStepForPatternIndex(pos);
-                    semitoneOffset = 1;
-                    pos = (pos + 1) % pattern.length();
-                }
-                else if (command == 'b')
-                {
-                    currentStepIndex = getStepForPatternIndex(pos);
-                    semitoneOffset = -1;
-                    pos = (pos + 1) % pattern.length();
-                }
-                else
-                {
-                    break; // Not a prefix, break to handle note commands.
-                }
+                releaseHeldNotes(midiBuffer, samplePosition);
+                playState->lastPlayedMidiNote = -1;
+                return;
             }
+        }
 
-            char command = pattern[pos];
-            currentStepIndex = getStepForPatternIndex(pos);
-            pos = (pos + 1) % pattern.length(); // Consume character
+        // --- 2. Fetch the precompiled step starting at the current position ---
+        const auto& step = compiledPattern->steps.getReference(playState->pos);
+        playState->pos = step.nextPos;
+        playState->currentStepIndex = step.stepIndex;
 
-            if (command == '_')
-            {
-                return midiBuffer; // Sustain note, exit immediately.
-            }
-            else if (juce::CharacterFunctions::isDigit(command))
-            {
-                // Convert 1-indexed pattern digit to 0-indexed internal degree.
-                // '1' -> 0, '2' -> 1, etc. '0' is not a valid note.
-                int degreeValue = command - '0';
-                if (degreeValue > 0)
-                    currentDegreeIndex = degreeValue - 1;
+        int currentDegreeIndex = playState->lastPlayedDegreeIndex;
+        int semitoneOffset = step.semitoneOffset; // For local sharp/flat modifiers
+        int localVelocity = step.localVelocity;   // For local velocity modifier
+        int localOctave = -1;                     // For local octave modifier
+        bool shouldUpdateLastDegree = true;
 
-                noteCommandFound = true;
-            }
-            else
-            {
-                // Handle other note commands
-                switch (command)
-                {
-                    case '+':
-                        currentDegreeIndex = (currentDegreeIndex + 1) % chord.getDegrees().size();
-                        noteCommandFound = true; break;
-                    case '-':
-                        currentDegreeIndex = (currentDegreeIndex + chord.getDegrees().size() - 1) % chord.getDegrees().size();
-                        noteCommandFound = true; break;
-                    case '?': 
-                        currentDegreeIndex = getRandomPresentDegree(); 
-                        noteCommandFound = true;
-                        // There are two possible behaviours
-                        // 1. The last played degree is updated by a '?' command,
-                        //    then it is taken ito account by '+' or '-'
-                        // 2. The last played degree is not updated by a '?' command
-                        // We choose option 1 for now
-                        // shouldUpdateLastDegree = false; 
-                        break;
-                    case '=': // Fall-through
-                    case '"': /* currentDegreeIndex remains the same */ noteCommandFound = true; break;
-                    case '.': currentDegreeIndex = -1; noteCommandFound = true; break;
-                    default: // Ignore invalid characters (like spaces) and continue loop.
-                        break;
-                }
-            }
+        if (step.hasOctaveModifiers)
+        {
+            const int octaveIndex = juce::jlimit(0, PatternStep::numOctaves - 1, playState->octave);
+            localOctave = step.localOctave[octaveIndex];
+            playState->octave = step.globalOctave[octaveIndex];
         }
+        if (step.globalVelocity != -1)
+            playState->globalVelocity = step.globalVelocity;
 
-        // --- Turn off the previous note ---
-        // This now happens *after* we've decided what the next command is.
-        if (lastPlayedMidiNote != -1)
+        switch (step.op)
         {
-            midiBuffer.addEvent(juce::MidiMessage::noteOff(lastPlayedMidiChannel, lastPlayedMidiNote), samplePosition);
-            lastPlayedMidiNote = -1;
+            case PatternStep::sustain:
+                return; // Sustain note, exit immediately.
+            case PatternStep::degree:
+                currentDegreeIndex = step.degreeIndex; break;
+            case PatternStep::next:
+                currentDegreeIndex = (currentDegreeIndex + 1) % chord.getNumDegrees(); break;
+            case PatternStep::previous:
+                currentDegreeIndex = (currentDegreeIndex + chord.getNumDegrees() - 1) % chord.getNumDegrees(); break;
+            case PatternStep::random:
+                currentDegreeIndex = getRandomPresentDegree();
+                // There are two possible behaviours
+                // 1. The last played degree is updated by a '?' command,
+                //    then it is taken ito account by '+' or '-'
+                // 2. The last played degree is not updated by a '?' command
+                // We choose option 1 for now
+                // shouldUpdateLastDegree = false;
+                break;
+            case PatternStep::rest:
+                currentDegreeIndex = -1; break;
+            case PatternStep::repeat: /* currentDegreeIndex remains the same */ break;
+            case PatternStep::chord:
+                // '+' and '-' continue from the last degree listed.
+                currentDegreeIndex = step.chordDegrees[step.numChordDegrees - 1]; break;
         }
 
-        // --- 3. Determine the final MIDI note to play ---
-        if (noteToPlay == -1 && currentDegreeIndex != -1) // If not sustaining and not a rest
-        {
-            // std::cout << "We should play a note!" << std::endl;
-            // std::cout << "currentDegreeIndex = " << currentDegreeIndex << std::endl;
+        // --- Turn off the previous notes ---
+        // This now happens *after* we've decided what the next command is.
+        // Notes played with a gate other than 100% have their note-off scheduled instead.
+        releaseHeldNotes(midiBuffer, samplePosition);
+        playState->lastPlayedMidiNote = -1;
+
+        if (currentDegreeIndex == -1) // A rest, or '?' on an empty chord
+            return;
+
+        // Use local velocity if set, otherwise use global velocity.
+        const juce::uint8 velocityToUse = (localVelocity != -1) ? (juce::uint8)localVelocity : (juce::uint8)playState->globalVelocity;
 
-            int finalNote = getNoteForDegree(currentDegreeIndex);
-            // std::cout << "     semitone = " << semitone << std::endl;
+        // Use the step's gate if set, otherwise the global gate. 100% holds notes until the next note command.
+        const double gateToUse = (step.gateQuarters > 0) ? step.gateQuarters * 0.25 : (double)gate.load(std::memory_order_relaxed);
+        const double lengthInSamples = (gateToUse != 1.0) ? (gateToUse + step.numSustainSteps) * samplesPerNote : 0.0;
 
-            if (finalNote != -1)
+        // --- 3. Determine the final MIDI note(s) and generate the events ---
+        if (step.op != PatternStep::chord)
+        {
+            const int noteToPlay = getMidiNoteForDegree(currentDegreeIndex, localOctave);
+            if (noteToPlay != -1)
             {
-                // Use local octave if set, otherwise use global octave.
-                int octaveToUse = (localOctave != -1) ? localOctave : octave;
-
-                // Calculate the octave offset from the base.
-                int octaveOffset = octaveToUse - baseOctave;
-                // For "Notes played" (0) and "Single note" (2) modes, the finalNote is a semitone (0-11)
-                // that needs to be placed in an absolute octave.
-                // For "Chord played as is" (1) mode, the finalNote is a full MIDI note that needs a relative offset.
-                if (chordMethod == 1)
-                    noteToPlay = finalNote + (octaveOffset * 12);
-                else // Modes 0 and 2
-                    noteToPlay = finalNote + (octaveToUse * 12);
+                startNote(midiBuffer, samplePosition, midiChannel, noteToPlay + semitoneOffset, velocityToUse, lengthInSamples);
+                if (shouldUpdateLastDegree)
+                    playState->lastPlayedDegreeIndex = currentDegreeIndex;
             }
+            return;
         }
-        
-        // --- 4. Generate MIDI event ---
-        if (noteToPlay != -1 )
+
+        // A strummed chord delays each note by the strum time, keeping the whole strum within the step.
+        const double strumDelay = step.strum ? strumTime.load(std::memory_order_relaxed) * 0.001 * sampleRate : 0.0;
+        int chordNotes[PatternStep::maxChordDegrees];
+        int numChordNotes = 0;
+        for (int i = 0; i < step.numChordDegrees; ++i)
+        {
+            const int noteToPlay = getMidiNoteForDegree(step.chordDegrees[i], localOctave);
+            // Absent degrees can resolve to a note already in the chord; play it once.
+            if (noteToPlay == -1 || std::find(chordNotes, chordNotes + numChordNotes, noteToPlay) != chordNotes + numChordNotes)
+                continue;
+            chordNotes[numChordNotes++] = noteToPlay;
+
+            const auto delay = (juce::int64)juce::jmin(i * strumDelay, i * samplesPerNote / step.numChordDegrees);
+            if (delay > 0 && ! scheduledEvents.isFull())
+                scheduledEvents.push({ sampleTime + samplePosition + delay, noteToPlay + semitoneOffset, midiChannel, velocityToUse, lengthInSamples });
+            else
+                startNote(midiBuffer, samplePosition, midiChannel, noteToPlay + semitoneOffset, velocityToUse, lengthInSamples);
+        }
+        playState->lastPlayedDegreeIndex = currentDegreeIndex;
+    }
+
+    /**
+        Places a degree in the octave to play, before any sharp/flat.
+        @return A MIDI note number, or -1 if the degree plays nothing.
+    */
+    int getMidiNoteForDegree(int degreeIndex, int localOctave) const
+    {
+        const int finalNote = getNoteForDegree(degreeIndex);
+        if (finalNote == -1)
+            return -1;
+
+        // Use local octave if set, otherwise use global octave.
+        const int octaveToUse = (localOctave != -1) ? localOctave : playState->octave;
+
+        // For "Notes played" (0) and "Single note" (2) modes, the finalNote is a semitone (0-11)
+        // that needs to be placed in an absolute octave.
+        // For "Chord played as is" (1) mode, the finalNote is a full MIDI note that needs a relative offset.
+        if (chordMethod == 1)
+            return finalNote + ((octaveToUse - baseOctave) * 12);
+        return finalNote + (octaveToUse * 12);
+    }
+
+    /**
+        Adds a note-on and records the note in the voice table.
+        @param lengthInSamples When above zero, the note-off is scheduled this many samples later;
+                               otherwise the note is held until the next note command.
+    */
+    void startNote(juce::MidiBuffer& midiBuffer, int samplePosition, int midiChannel, int note, juce::uint8 velocity, double lengthInSamples)
+    {
+        // A still-sounding copy of this note (e.g. from an overlapping gate) ends here,
+        // otherwise its note-off would cut the new note short.
+        const int existing = findVoice(note, midiChannel);
+        if (existing != -1)
+            stopVoice(midiBuffer, existing, samplePosition);
+        else if (numVoices == maxVoices)
+            stopVoice(midiBuffer, 0, samplePosition); // Steal the oldest voice.
+
+        // If the queue is full, the note is held until the next note command instead.
+        const bool held = lengthInSamples <= 0.0 || scheduledEvents.isFull();
+        if (! held)
         {
-            noteToPlay += semitoneOffset; // Apply sharp/flat
+            const auto length = juce::jmax((juce::int64)1, (juce::int64)std::llround(lengthInSamples));
+            scheduledEvents.push({ sampleTime + samplePosition + length, note, midiChannel, 0, 0.0 });
+        }
+
+        voices[(size_t)numVoices++] = { note, midiChannel, held };
+        midiBuffer.addEvent(juce::MidiMessage::noteOn(midiChannel, note, velocity), samplePosition);
+        playState->lastPlayedMidiNote = note;
+    }
+
+    int findVoice(int note, int midiChannel) const
+    {
+        for (int i = 0; i < numVoices; ++i)
+            if (voices[(size_t)i].note == note && voices[(size_t)i].channel == midiChannel)
+                return i;
+        return -1;
+    }
+
+    /** Adds the note-off of a voice, cancels its scheduled note-off, and removes it from the table. */
+    void stopVoice(juce::MidiBuffer& midiBuffer, int voiceIndex, int samplePosition)
+    {
+        const auto voice = voices[(size_t)voiceIndex];
+        midiBuffer.addEvent(juce::MidiMessage::noteOff(voice.channel, voice.note), samplePosition);
+        if (! voice.held)
+            scheduledEvents.removeFirst([&voice](const ScheduledEvent& event)
+            {
+                return event.velocity == 0 && event.note == voice.note && event.channel == voice.channel;
+            });
+        removeVoice(voiceIndex);
+    }
+
+    /** Removes a voice, keeping the others oldest first. */
+    void removeVoice(int voiceIndex)
+    {
+        for (int i = voiceIndex + 1; i < numVoices; ++i)
+            voices[(size_t)(i - 1)] = voices[(size_t)i];
+        --numVoices;
+    }
 
-            // Use local velocity if set, otherwise use global velocity.
-            juce::uint8 velocityToUse = (localVelocity != -1) ? (juce::uint8)localVelocity : (juce::uint8)globalVelocity;
-            midiBuffer.addEvent(juce::MidiMessage::noteOn(midiChannel, noteToPlay, velocityToUse), samplePosition);
-            lastPlayedMidiNote = noteToPlay;
-            lastPlayedMidiChannel = midiChannel;
-            if (shouldUpdateLastDegree)
-                lastPlayedDegreeIndex = currentDegreeIndex;
+    /** Adds note-offs for the notes held until the next note command. */
+    void releaseHeldNotes(juce::MidiBuffer& midiBuffer, int samplePosition)
+    {
+        int kept = 0;
+        for (int i = 0; i < numVoices; ++i)
+        {
+            const auto voice = voices[(size_t)i];
+            if (voice.held)
+                midiBuffer.addEvent(juce::MidiMessage::noteOff(voice.channel, voice.note), samplePosition);
+            else
+                voices[(size_t)kept++] = voice;
         }
+        numVoices = kept;
+    }
 
-        // std::cout << "     noteToplay = " << noteToPlay << std::endl;
-        // std::cout << "     Num events = " << midiBuffer.getNumEvents() << std::endl;
+    /** Adds the scheduled note-ons and note-offs falling at or before lastSamplePosition in the current block. */
+    void releaseDueEvents(juce::MidiBuffer& midiBuffer, int lastSamplePosition)
+    {
+        while (! scheduledEvents.isEmpty() && scheduledEvents.top().time <= sampleTime + lastSamplePosition)
+        {
+            const auto event = scheduledEvents.pop();
+            const int offset = (int)juce::jmax((juce::int64)0, event.time - sampleTime);
+            if (event.velocity > 0)
+            {
+                startNote(midiBuffer, offset, event.channel, event.note, event.velocity, event.lengthInSamples);
+            }
+            else
+            {
+                const int voiceIndex = findVoice(event.note, event.channel);
+                if (voiceIndex != -1)
+                {
+                    midiBuffer.addEvent(juce::MidiMessage::noteOff(event.channel, event.note), offset);
+                    removeVoice(voiceIndex);
+                }
+            }
+        }
+    }
 
-        return midiBuffer;
+    /** Adds note-offs for every sounding note at samplePosition and drops notes not started yet. O(voices). */
+    void releaseAllNotes(juce::MidiBuffer& midiBuffer, int samplePosition)
+    {
+        for (int i = 0; i < numVoices; ++i)
+            midiBuffer.addEvent(juce::MidiMessage::noteOff(voices[(size_t)i].channel, voices[(size_t)i].note), samplePosition);
+        numVoices = 0;
+        scheduledEvents.clear();
+        playState->lastPlayedMidiNote = -1;
+        notesNeedRelease = false;
     }
 
 public:
@@ -311,18 +543,76 @@ public:
     }
 public:
     // --- Setters for properties ---
+
+    /*  setChord(), setPattern() and setPlayNoteOffMode() may be called from the message
+        thread while processBlock() runs. They build the new state here (allocating and
+        compiling off the audio thread) and publish it with one atomic pointer exchange.
+        The audio thread picks it up at the start of its next call by swapping it into
+        place, which never allocates or blocks. The replaced state is handed back and
+        deleted on the next publish, by releaseRetiredChanges(), or by the destructor.
+        These three setters must all be called from the same (non-audio) thread.
+    */
     void setChord(const MidiTools::Chord& newChord)
+    {
+        publishedChord = newChord;
+        auto* changes = new PendingChanges();
+        changes->chord = newChord.getValue();
+        changes->hasChord = true;
+        publishChanges(changes);
+    }
+
+    /**
+        Replaces the chord immediately, without allocating. Call this from the audio thread,
+        e.g. when rebuilding the chord from incoming notes in "Notes played" mode.
+        Do not mix it with setChord(const MidiTools::Chord&) on the same arpeggiator:
+        a chord published from another thread would replace this one on the next block.
+    */
+    void setChord(const MidiTools::ChordValue& newChord)
     {
         chord = newChord;
+        updateDegreeTable();
     }
+
+    /**
+        Replaces the chord with the notes currently held, without allocating: call this from
+        the audio thread after feeding note events to a MidiTools::HeldNotes, in the
+        "Notes played" and "Chord played as is" modes. The caveat of the ChordValue overload applies.
+    */
+    void setChord(const MidiTools::HeldNotes& heldNotes) { setChord(heldNotes.getChordValue()); }
     void setPattern(const juce::String& newPattern)
     {
-        pattern = newPattern;
-        pos = 0;
-        octave = baseOctave; // Reset octave on pattern change for a clean start.
+        publishedPattern = newPattern.substring(0, maxPatternLength);
+        auto* changes = new PendingChanges();
+        changes->pattern = publishedPattern;
+        changes->compiledPattern = compileShared(publishedPattern);
+        changes->hasPattern = true; // Also resets the position and octave for a clean start.
+        publishChanges(changes);
+    }
+    void setOctave(int newOctave) { playState->octave = juce::jlimit(0, 7, newOctave); }
+    void setPlayNoteOffMode(const juce::String& mode)
+    {
+        auto* changes = new PendingChanges();
+        changes->playNoteOff = mode == "Off"      ? PlayNoteOffMode::off
+                             : mode == "Next"     ? PlayNoteOffMode::next
+                             : mode == "Previous" ? PlayNoteOffMode::previous
+                                                  : PlayNoteOffMode::root;
+        changes->hasPlayNoteOff = true;
+        publishChanges(changes);
+    }
+
+    /**
+        Deletes state replaced by the audio thread since the last publish.
+        Call this periodically from the thread that calls the setters (e.g. a timer)
+        if you want memory released without waiting for the next change.
+    */
+    void releaseRetiredChanges()
+    {
+        int start1, size1, start2, size2;
+        retiredFifo.prepareToRead(retiredFifo.getNumReady(), start1, size1, start2, size2);
+        for (int i = 0; i < size1; ++i) delete retiredChanges[(size_t)(start1 + i)];
+        for (int i = 0; i < size2; ++i) delete retiredChanges[(size_t)(start2 + i)];
+        retiredFifo.finishedRead(size1 + size2);
     }
-    void setOctave(int newOctave) { octave = juce::jlimit(0, 7, newOctave); }
-    void setPlayNoteOffMode(const juce::String& mode) { playNoteOff = mode; }
     void setTempo(double newTempoBPM)
     {
         tempoBPM = newTempoBPM > 0 ? newTempoBPM : 120.0;
@@ -335,9 +625,110 @@ public:
         updateSamplesPerNote();
     }
 
+    double getTempo() const     { return tempoBPM; }
+    int getSubdivision() const  { return subdivision; }
+
+    /** The number of subdivision indices accepted by setSubdivision(), from 1/4 (0) to 1/64T (9). */
+    static constexpr int numSubdivisions = 10;
+
+    /**
+        Returns the number of steps per quarter note for a subdivision index.
+        Indices out of range give 1/16.
+    */
+    static double getNoteDivisor(int subdivisionIndex)
+    {
+        switch (subdivisionIndex)
+        {
+            case 0: return 1.0;  // 1/4
+            case 1: return 1.5;  // 1/4T
+            case 2: return 2.0;  // 1/8
+            case 3: return 3.0;  // 1/8T
+            case 4: return 4.0;  // 1/16
+            case 5: return 6.0;  // 1/16T
+            case 6: return 8.0;  // 1/32
+            case 7: return 12.0; // 1/32T
+            case 8: return 16.0; // 1/64
+            case 9: return 24.0; // 1/64T
+            default: return 4.0;
+        }
+    }
+
+    /**
+        Sets the global gate, as a fraction of a step (0.01 to 16). 1 holds each note until
+        the next note command; other values schedule note-offs (see the class description).
+        Steps with a 'gN' prefix use their own gate. Safe to call from any thread.
+    */
+    void setGate(float newGate)
+    {
+        gate.store(juce::jlimit(0.01f, 16.0f, newGate), std::memory_order_relaxed);
+    }
+
+    float getGate() const
+    {
+        return gate.load(std::memory_order_relaxed);
+    }
+
+    /** Sets the delay between consecutive notes of a strummed '{...}' step, in milliseconds (0 to 1000). */
+    void setStrumTime(float milliseconds)
+    {
+        strumTime.store(juce::jlimit(0.0f, 1000.0f, milliseconds), std::memory_order_relaxed);
+    }
+
+    /**
+        Gates the pattern with a Euclidean rhythm. Each step of the arpeggiator takes one step of
+        the rhythm: on a hit the pattern plays its next step, otherwise the step is a rest and the
+        pattern waits. E.g. the pattern "123" with E(3,8) plays 1..2..3. and starts over.
+        Unlike setPattern(makeEuclidianPattern(...)), this never allocates or recompiles the pattern,
+        so it can follow a knob continuously. Callable from any thread.
+        @param hits     The number of hits, 0 to steps.
+        @param steps    The length of the rhythm, 1 to 64; 0 turns the gating off.
+        @param rotation Moves every hit this many steps later, wrapping around.
+    */
+    void setEuclideanRhythm(int hits, int steps, int rotation = 0,
+                            MidiTools::EuclideanAlgorithm algorithm = MidiTools::EuclideanAlgorithm::bresenham)
+    {
+        MidiTools::EuclideanTable::getInstance(); // Built here rather than on the audio thread.
+
+        steps = juce::jlimit(0, 64, steps);
+        hits = juce::jlimit(0, steps, hits);
+        rotation = steps > 0 ? ((rotation % steps) + steps) % steps : 0;
+
+        // One word, so the audio thread never sees half of a change.
+        rhythmSettings.store((juce::uint32)hits | ((juce::uint32)steps << 7) | ((juce::uint32)rotation << 14)
+                                 | ((juce::uint32)algorithm << 20),
+                             std::memory_order_relaxed);
+    }
+
+    /** Turns off the rhythm set by setEuclideanRhythm(): every step plays the pattern again. */
+    void clearRhythm()
+    {
+        rhythmSettings.store(0, std::memory_order_relaxed);
+    }
+
     void setChordMethod(int methodIndex)
     {
-        chordMethod = methodIndex;
+        publishedChordMethod.store(methodIndex, std::memory_order_relaxed);
+    }
+
+    /**
+        Makes "Single note" mode follow a MidiTools::ScaleDetector: at the start of each block,
+        if the detected scale or the note given to setSingleNote() has changed, the chord is
+        rebuilt as Chord::fromScaleAndDegree() would from that scale and the note's scale degree,
+        without allocating. Feed the detector and call its advance() before processBlock() so
+        the chord follows within the same block. The detector must outlive its use here;
+        pass nullptr to stop following.
+        @param chordMode As for Chord::fromScaleAndDegree().
+    */
+    void followScale(const MidiTools::ScaleDetector* detector, bool chordMode = false)
+    {
+        followedChordMode.store(chordMode, std::memory_order_relaxed);
+        followedDetector.store(detector, std::memory_order_release);
+    }
+
+    /** Sets the note played in "Single note" mode, whose scale degree followScale() builds the chord on. */
+    void setSingleNote(int midiNoteNumber)
+    {
+        singleNote.store(midiNoteNumber, std::memory_order_relaxed);
     }
 
     /**
@@ -354,7 +745,7 @@ public:
         int diff = newBaseOctave - baseOctave;
         baseOctave = newBaseOctave;
         // Adjust the current octave by the difference to maintain relative shifts
-        octave = juce::jlimit(0, 7, octave + diff);
+        playState->octave = juce::jlimit(0, 7, playState->octave + diff);
     }
 
     /**
@@ -368,7 +759,7 @@ public:
         {
             int velocityLevel = static_cast<int>(std::ceil(static_cast<float>(midiVelocity) / 16.0f));
             velocityLevel = juce::jlimit(1, 8, velocityLevel); // Ensure it's within 1-8 range
-            globalVelocity = juce::jmin(127, velocityLevel * 16);
+            playState->globalVelocity = juce::jmin(127, velocityLevel * 16);
         }
     }
 
@@ -379,11 +770,24 @@ public:
     */
     juce::String makeEuclidianPattern(int hits, int steps, int rotation)
     {
-        auto bools = MidiTools::euclidianRythm(hits, steps, rotation);
-        juce::String s;
-        for (bool b : bools)
-            s += (b ? "1 " : ". ");
-        return s.trim();
+        if (steps > 64)
+        {
+            auto bools = MidiTools::euclidianRythm(hits, steps, rotation);
+            juce::String s;
+            for (bool b : bools)
+                s += (b ? "1 " : ". ");
+            return s.trim();
+        }
+
+        // Write the characters directly instead of growing a juce::String step by step.
+        const auto mask = MidiTools::euclideanMask(hits, steps, rotation);
+        char text[64 * 2];
+        for (int i = 0; i < steps; ++i)
+        {
+            text[i * 2] = ((mask >> i) & 1) != 0 ? '1' : '.';
+            text[i * 2 + 1] = ' ';
+        }
+        return juce::String(text, (size_t)juce::jmax(0, steps * 2 - 1));
     }
 
     /**
@@ -395,7 +799,7 @@ public:
     */
     juce::String makeRandomPattern()
     {
-        juce::Random& rng = juce::Random::getSystemRandom();
+        auto& rng = patternRandom;
         int length = rng.nextInt(13) + 4; // Random length between 4 and 16
 
         struct Step {
@@ -471,102 +875,123 @@ public:
         return newPattern.trim();
     }
 
+    /**
+        Reseeds the generators used for '?' steps and by makeRandomPattern(), so that
+        renders and generated patterns can be reproduced exactly. Each arpeggiator has its
+        own generators; call this before playback or from the audio thread.
+    */
+    void setRandomSeed(juce::uint64 seed)
+    {
+        stepRandom.setSeed(seed);
+        patternRandom.setSeed(~seed);
+    }
+
     void randomize()
     {
         setPattern(makeRandomPattern());
     }
 
-    /** Returns the current pattern string. */
+    /** Longer patterns are truncated by setPattern() and the constructor. */
+    static constexpr int maxPatternLength = 1024;
+
+    /**
+        Checks a pattern for problems worth reporting to the user, e.g. from a text editor.
+        Invalid patterns can still be set safely; this only explains why they may not play
+        as intended.
+        @return juce::Result::ok(), or a failure describing the first problem found.
+    */
+    static juce::Result validatePattern(const juce::String& patternToCheck)
+    {
+        if (patternToCheck.length() > maxPatternLength)
+            return juce::Result::fail("Pattern is longer than " + juce::String(maxPatternLength) + " characters");
+
+        CompiledPattern compiled;
+        compilePattern(patternToCheck, compiled);
+
+        for (const auto& step : compiled.steps)
+            if (! step.hasNoteCommand)
+                return juce::Result::fail("Pattern contains modifiers that are not followed by a note command");
+
+        for (int i = 0; i < patternToCheck.length(); ++i)
+        {
+            const auto c = patternToCheck[i];
+            if ((c == '[' && patternToCheck.indexOfChar(i + 1, ']') == -1) || (c == '{' && patternToCheck.indexOfChar(i + 1, '}') == -1))
+                return juce::Result::fail("Pattern has a '" + juce::String::charToString(c) + "' without its closing bracket");
+        }
+
+        const auto trimmed = patternToCheck.trimEnd();
+        if (trimmed.isNotEmpty())
+        {
+            const auto last = trimmed.getLastCharacter();
+            const auto beforeLast = trimmed.length() > 1 ? trimmed[trimmed.length() - 2] : 0;
+            const bool lastIsArgument = beforeLast == 'o' || beforeLast == 'O' || beforeLast == 'v' || beforeLast == 'V' || beforeLast == 'g';
+            if (last == 'o' || last == 'O' || last == 'v' || last == 'V' || last == 'g' || last == '#' || last == 'b' || lastIsArgument)
+                return juce::Result::fail("Pattern ends with a modifier; it will apply to the first note");
+        }
+
+        return juce::Result::ok();
+    }
+
+    /**
+        Returns the rhythm of a pattern, e.g. for a MidiTools::RhythmIndex: every step that
+        plays ('1', '+', '?', '=', '[135]'...) is a hit, '_' is a sustain and '.' is a rest.
+        Only the first 64 steps are kept.
+    */
+    static MidiTools::RhythmMasks getRhythmMasks(const juce::String& patternToAnalyse)
+    {
+        CompiledPattern compiled;
+        compilePattern(patternToAnalyse, compiled);
+
+        MidiTools::RhythmMasks masks;
+        masks.length = juce::jmin(64, compiled.numSteps);
+        for (int i = 0; i < masks.length; ++i)
+        {
+            const auto op = compiled.steps.getReference(compiled.patternIndexForStep[i]).op;
+            if (op == PatternStep::sustain)
+                masks.sustains |= (juce::uint64)1 << i;
+            else if (op != PatternStep::rest)
+                masks.hits |= (juce::uint64)1 << i;
+        }
+        return masks;
+    }
+
+    /** Returns the pattern string most recently passed to setPattern().
+        Intended for the thread that calls the setters. */
     const juce::String& getPattern() const
     {
-        return pattern;
+        return publishedPattern;
     }
 
-    /** Returns a const reference to the currently active chord. */
+    /** Returns the chord most recently passed to setChord().
+        Intended for the thread that calls the setters. */
     const MidiTools::Chord& getChord() const
     {
-        return chord;
+        return publishedChord;
     }
 
     /** Returns the index of the current musical step being played. */
     int getCurrentStepIndex() const
     {
-        return currentStepIndex;
+        return playState->currentStepIndex;
     }
 
-    /** Returns the last MIDI note number that was played. */
+    /** Returns the last MIDI note number that was played (the last note started, for chord steps). */
     int getLastPlayedNote() const
     {
-        return lastPlayedMidiNote;
+        return playState->lastPlayedMidiNote;
     }
-    /** Calculates the number of musical steps in the pattern string. */
+    /** Returns the number of musical steps in the pattern string. */
     int numSteps() const
     {
-        if (pattern.isEmpty())
-            return 0;
-
-        int steps = 0;
-        int i = 0;
-        while (i < pattern.length())
-        {
-            const char command = pattern[i];
-            if (command == 'o' || command == 'O' || command == 'v' || command == 'V')
-            {
-                i += 2; // Skip 'o' and its argument
-            }
-            else if (command == '#' || command == 'b')
-            {
-                i++; // Skip sharp/flat prefix
-            }
-            else if (juce::CharacterFunctions::isDigit(command) || command == '+' ||
-                     command == '-' || command == '?' || command == '"' ||
-                     command == '=' || command == '.' || command == '_')
-            {
-                steps++; // This is a valid step command
-                i++; // Consume the command
-            }
-            else
-            {
-                i++; // Ignore and consume other characters (like spaces)
-            }
-        }
-        return steps;
-    }
+        return compiledPattern->numSteps;
+    }
 
     /** Given a step index (0, 1, 2...), find the corresponding character index in the pattern string. */
     int getPatternIndexForStep(int stepIndex) const
     {
-        if (pattern.isEmpty())
-            return 0;
-
-        int currentStepCount = 0;
-        int i = 0;
-        while (i < pattern.length())
-        {
-            if (currentStepCount == stepIndex)
-                return i; // Found the start of the desired step
-
-            const char command = pattern[i];
-            if (command == 'o' || command == 'O' || command == 'v' || command == 'V')
-            {
-                i += 2; // Skip 'o' and its argument
-            }
-            else if (command == '#' || command == 'b')
-            {
-                i++; // Skip sharp/flat prefix
-            }
-            else if (juce::CharacterFunctions::isDigit(command) || command == '+' ||
-                     command == '-' || command == '?' || command == '"' ||
-                     command == '=' || command == '.' || command == '_')
-            {
-                currentStepCount++;
-                i++; // Consume the command
-            }
-            else
-            {
-                i++; // Ignore and consume other characters (like spaces)
-            }
-        }
+        const auto& table = compiledPattern->patternIndexForStep;
+        if (juce::isPositiveAndBelow(stepIndex, table.size()))
+            return table.getUnchecked(stepIndex);
         return 0; // Fallback if stepIndex is out of bounds
     }
 
@@ -575,33 +1000,8 @@ public:
     {
         if (pattern.isEmpty() || patternIndex < 0)
             return 0;
-
-        int stepCount = 0;
-        int i = 0;
-        while (i < pattern.length() && i < patternIndex)
-        {
-            const char command = pattern[i];
-            if (command == 'o' || command == 'O' || command == 'v' || command == 'V')
-            {
-                i += 2; // Skip command and its argument
-            }
-            else if (command == '#' || command == 'b')
-            {
-                i++; // Skip prefix
-            }
-            else if (juce::CharacterFunctions::isDigit(command) || command == '+' ||
-                     command == '-' || command == '?' || command == '"' ||
-                     command == '=' || command == '.' || command == '_')
-            {
-                stepCount++;
-                i++;
-            }
-            else
-            {
-                i++; // Ignore other characters
-            }
-        }
-        return stepCount;
+        const auto& table = compiledPattern->stepForPatternIndex;
+        return table.getUnchecked(juce::jmin(patternIndex, table.size() - 1));
     }
 
     /** Returns the total duration of one full pattern loop in PPQ. */
@@ -622,6 +1022,8 @@ public:
     */
     void syncToPlayHead(const juce::AudioPlayHead::CurrentPositionInfo& positionInfo)
     {
+        applyPendingChanges();
+
         if (samplesPerNote <= 0.0 || positionInfo.ppqPosition < 0.0 || pattern.isEmpty())
             return;
     
@@ -646,16 +1048,25 @@ public:
     juce::MidiBuffer reset(int midiChannel = 1, const juce::Optional<juce::AudioPlayHead::CurrentPositionInfo> positionInfo = {})
     {
         juce::MidiBuffer noteOffBuffer;
-        if (lastPlayedMidiNote != -1)
-        {
-            noteOffBuffer.addEvent(juce::MidiMessage::noteOff(lastPlayedMidiChannel, lastPlayedMidiNote), 0);
-            lastPlayedMidiNote = -1;
-        }
+        reset(noteOffBuffer, midiChannel, positionInfo);
+        return noteOffBuffer;
+    }
 
-        octave = baseOctave;
-        globalVelocity = 96; // Reset global velocity to default
-        pos = 0;
-        lastPlayedDegreeIndex = 0;
+    /**
+        Resets the arpeggiator's position to the beginning of the pattern, appending the
+        note-offs of every sounding note to midiOut at sample 0. Safe to call on the audio
+        thread: nothing is allocated as long as midiOut was sized with prepareMidiBuffer().
+    */
+    void reset(juce::MidiBuffer& midiOut, int midiChannel = 1, const juce::Optional<juce::AudioPlayHead::CurrentPositionInfo> positionInfo = {})
+    {
+        applyPendingChanges();
+        releaseAllNotes(midiOut, 0);
+
+        playState->octave = baseOctave;
+        playState->globalVelocity = 96; // Reset global velocity to default
+        playState->pos = 0;
+        rhythmPos = 0;
+        playState->lastPlayedDegreeIndex = 0;
         samplesUntilNextNote = 0;
 
         // If host position is provided (i.e., transport just started), sync to it.
@@ -667,66 +1078,86 @@ public:
                 const double stepDurationPPQ = 1.0 / getNoteDivisor();
                 const double songPosInSteps = positionInfo->ppqPosition / stepDurationPPQ;
                 const double patternDurationInSteps = patternDurationPPQ / stepDurationPPQ;
-                const int nextStepIndex = static_cast<int>(std::floor(songPosInSteps)) % static_cast<int>(patternDurationInSteps);
-                pos = getPatternIndexForStep(nextStepIndex);
+                juce::int64 songStep = static_cast<juce::int64>(std::floor(songPosInSteps));
+                if (rhythmSteps > 0)
+                {
+                    // The pattern only advances on hits: count those before this step.
+                    rhythmPos = (int)(songStep % rhythmSteps);
+                    songStep = (songStep / rhythmSteps) * juce::countNumberOfBits(rhythmMask)
+                             + juce::countNumberOfBits(rhythmMask & MidiTools::getStepsMask(rhythmPos));
+                }
+                const int nextStepIndex = static_cast<int>(songStep % static_cast<juce::int64>(patternDurationInSteps));
+                playState->pos = getPatternIndexForStep(nextStepIndex);
                 samplesUntilNextNote = 0; // Trigger immediate evaluation for the current position
             }
         }
-
-        return noteOffBuffer;
     }
 
-    /** Generates a note-off for the last played note and resets the state. */
+    /** Generates note-offs for every sounding note and resets the state. */
     juce::MidiBuffer turnOff(int midiChannel = 1)
     {
         juce::MidiBuffer noteOffBuffer;
-        if (lastPlayedMidiNote != -1)
-        {
-            noteOffBuffer.addEvent(juce::MidiMessage::noteOff(lastPlayedMidiChannel, lastPlayedMidiNote), 0);
-            lastPlayedMidiNote = -1;
-        }
-        // Also reset pattern position and other state variables for a clean start next time.
-        pos = 0;
-        lastPlayedDegreeIndex = 0;
-        octave = baseOctave;
+        turnOff(noteOffBuffer, midiChannel);
         return noteOffBuffer;
     }
 
+    /**
+        Appends note-offs for every sounding note to midiOut at sample 0 and resets the state.
+        Like the in-place reset(), this never allocates on a prepared buffer.
+    */
+    void turnOff(juce::MidiBuffer& midiOut, int midiChannel = 1)
+    {
+        releaseAllNotes(midiOut, 0);
+        // Also reset pattern position and other state variables for a clean start next time.
+        playState->pos = 0;
+        rhythmPos = 0;
+        playState->lastPlayedDegreeIndex = 0;
+        playState->octave = baseOctave;
+    }
+
 protected:
     /**
         Finds a valid semitone for a given degree index, handling absent notes.
         For "Notes played" mode, it returns a semitone (0-11).
         For "Chord played as is" mode, it returns a full MIDI note number (0-127).
+        This is a single table read for every degree index a pattern can produce.
     */
-    int getNoteForDegree(int degreeIndex)
+    int getNoteForDegree(int degreeIndex) const
+    {
+        if (juce::isPositiveAndBelow(degreeIndex, degreeTableSize))
+            return noteForDegree[(size_t)degreeIndex];
+        return computeNoteForDegree(degreeIndex);
+    }
+
+    /** Resolves a degree index against the current chord, chord method and absent-degree mode. */
+    int computeNoteForDegree(int degreeIndex) const
     {
         if (chordMethod == 1) // "Chord played as is"
         {
-            const auto& rawNotes = chord.getRawNotes();
-            if (rawNotes.isEmpty())
+            const int numRawNotes = chord.getNumRawNotes();
+            if (numRawNotes == 0)
                 return -1;
             
             // Wrap the degree index around the number of notes being held.
-            return rawNotes[degreeIndex % rawNotes.size()];
+            return chord.getRawNote(degreeIndex % numRawNotes);
         }
         else // "Notes played" (mode 0) and "Single note" (mode 2)
         {
-            const auto& degrees = chord.getDegrees();
-            if (degrees.isEmpty())
+            const int numDegrees = chord.getNumDegrees();
+            if (numDegrees == 0)
                 return -1;
-            if (!juce::isPositiveAndBelow(degreeIndex, degrees.size()))
-                degreeIndex %= degrees.size(); // Wrap around if degree is > scale size
+            if (!juce::isPositiveAndBelow(degreeIndex, numDegrees))
+                degreeIndex %= numDegrees; // Wrap around if degree is > scale size
 
             // If we are using a "Custom" chord from played notes, we should loop within the number of notes played.
-            if (chord.getName() == "Custom")
+            if (chord.isCustom())
             {
-                juce::SortedSet<int> playedNotes = chord.getSortedSet();
-                int numPlayedNotes = playedNotes.size();
+                int numPlayedNotes = chord.getNumDistinctDegrees();
 
                 if (numPlayedNotes > 0)
                 {
                     // Use modulo to wrap the degree index around the number of notes being held.
-                    return playedNotes[degreeIndex % numPlayedNotes];
+                    return chord.getSortedDegree(degreeIndex % numPlayedNotes);
                 }
             }
 
@@ -736,23 +1167,23 @@ protected:
                 return semitone;
 
             // If the degree is absent, handle it based on the mode
-            if (playNoteOff == "Off")
+            if (playNoteOff == PlayNoteOffMode::off)
             {
                 return -1;
             }
-            else if (playNoteOff == "Next")
+            else if (playNoteOff == PlayNoteOffMode::next)
             {
-                for (int i = 1; i < degrees.size(); ++i)
+                for (int i = 1; i < numDegrees; ++i)
                 {
-                    semitone = chord.getDegree((degreeIndex + i) % degrees.size());
+                    semitone = chord.getDegree((degreeIndex + i) % numDegrees);
                     if (semitone != -1) return semitone;
                 }
             }
-            else if (playNoteOff == "Previous")
+            else if (playNoteOff == PlayNoteOffMode::previous)
             {
-                for (int i = 1; i < degrees.size(); ++i)
+                for (int i = 1; i < numDegrees; ++i)
                 {
-                    semitone = chord.getDegree((degreeIndex + degrees.size() - i) % degrees.size());
+                    semitone = chord.getDegree((degreeIndex + numDegrees - i) % numDegrees);
                     if (semitone != -1) return semitone;
                 }
             }
@@ -770,56 +1201,587 @@ protected:
     {
         if (chordMethod == 1)
         {
-            if (chord.getRawNotes().isEmpty())
+            if (chord.getNumRawNotes() == 0)
                 return -1;
-            return juce::Random::getSystemRandom().nextInt(chord.getRawNotes().size());
+            return stepRandom.nextInt(chord.getNumRawNotes());
+        }
+
+        if (numPresentDegrees == 0)
+            return -1;
+
+        return presentDegrees[(size_t)stepRandom.nextInt(numPresentDegrees)];
+    }
+
+    /**
+        Rebuilds the degree-to-note table and the present-degree list. Runs on the audio thread
+        whenever the chord, chord method or absent-degree mode changes; never allocates.
+    */
+    void updateDegreeTable()
+    {
+        for (int i = 0; i < degreeTableSize; ++i)
+            noteForDegree[(size_t)i] = computeNoteForDegree(i);
+
+        numPresentDegrees = 0;
+        for (int i = 0; i < chord.getNumDegrees(); ++i)
+        {
+            if (chord.getDegree(i) != -1)
+                presentDegrees[(size_t)numPresentDegrees++] = i;
+        }
+    }
+
+
+    /**
+        One step of a compiled pattern: all the prefixes preceding a note command,
+        folded together with the command itself. Built by compilePattern() so that
+        getNext() never has to look at the pattern string.
+    */
+    struct PatternStep
+    {
+        enum Op : juce::uint8 { degree, next, previous, random, repeat, rest, sustain, chord };
+
+        /** Octave modifiers are resolved for every possible global octave on entry (0-9). */
+        static constexpr int numOctaves = 10;
+        /** Degrees beyond this in a '[...]' step are ignored. */
+        static constexpr int maxChordDegrees = 8;
+
+        Op op = repeat;
+        juce::int8 degreeIndex = 0;     // Target degree for Op::degree (0-indexed).
+        juce::int8 semitoneOffset = 0;  // Result of '#'/'b' prefixes.
+        juce::int16 localVelocity = -1; // Result of 'v' prefixes, -1 if none.
+        juce::int16 globalVelocity = -1; // Result of 'V' prefixes, -1 if none.
+        juce::int8 gateQuarters = 0;     // Result of 'g' prefixes, in quarters of a step; 0 if none.
+        juce::int16 numSustainSteps = 0; // '_' steps directly following this one, lengthening a gated note.
+        juce::int8 chordDegrees[maxChordDegrees] {}; // Degrees of Op::chord, in the order listed.
+        juce::int8 numChordDegrees = 0;
+        bool strum = false; // Op::chord written with '{...}'.
+        bool hasOctaveModifiers = false;
+        bool hasNoteCommand = false; // False when no note command could be reached; plays as a repeat.
+        juce::int8 localOctave[numOctaves] {};  // Local octave after 'o'/'O' prefixes, -1 if none.
+        juce::int8 globalOctave[numOctaves] {}; // Global octave after 'o'/'O' prefixes.
+        int stepIndex = 0; // Musical step index reported by getCurrentStepIndex().
+        int nextPos = 0;   // Pattern index at which the following step starts.
+    };
+
+    /** What to play for a degree absent from the chord, set by setPlayNoteOffMode(). */
+    enum class PlayNoteOffMode
+    {
+        off,      // "Off": play nothing.
+        next,     // "Next": the next present degree.
+        previous, // "Previous": the previous present degree.
+        root      // Any other string: the fundamental.
+    };
+
+    /** A pattern compiled to step records, with its step <-> character index tables. */
+    struct CompiledPattern
+    {
+        juce::Array<PatternStep> steps;       // One entry per pattern character index.
+        juce::Array<int> patternIndexForStep; // Character index at which each step starts.
+        juce::Array<int> stepForPatternIndex; // Steps preceding each character index (length + 1 entries).
+        int numSteps = 0;
+    };
+
+    /** State built by the setters and swapped in by the audio thread. */
+    struct PendingChanges
+    {
+        MidiTools::ChordValue chord;
+        juce::String pattern;
+        std::shared_ptr<const CompiledPattern> compiledPattern;
+        PlayNoteOffMode playNoteOff = PlayNoteOffMode::next;
+        bool hasChord = false;
+        bool hasPattern = false;
+        bool hasPlayNoteOff = false;
+    };
+
+    /** Publishes new state for the audio thread, merging any state it has not picked up yet. */
+    void publishChanges(PendingChanges* changes)
+    {
+        releaseRetiredChanges();
+
+        if (auto* unclaimed = pendingChanges.exchange(nullptr, std::memory_order_acq_rel))
+        {
+            if (! changes->hasChord && unclaimed->hasChord)
+            {
+                changes->chord = unclaimed->chord;
+                changes->hasChord = true;
+            }
+            if (! changes->hasPattern && unclaimed->hasPattern)
+            {
+                changes->pattern = std::move(unclaimed->pattern);
+                changes->compiledPattern = std::move(unclaimed->compiledPattern);
+                changes->hasPattern = true;
+            }
+            if (! changes->hasPlayNoteOff && unclaimed->hasPlayNoteOff)
+            {
+                changes->playNoteOff = unclaimed->playNoteOff;
+                changes->hasPlayNoteOff = true;
+            }
+            delete unclaimed;
+        }
+
+        pendingChanges.store(changes, std::memory_order_release);
+    }
+
+    /** Picks up a rhythm set by setEuclideanRhythm(), keeping the position within it. */
+    void updateRhythm()
+    {
+        const auto settings = rhythmSettings.load(std::memory_order_relaxed);
+        if (settings == appliedRhythmSettings)
+            return;
+
+        appliedRhythmSettings = settings;
+        const int hits = (int)(settings & 0x7f);
+        rhythmSteps = (int)((settings >> 7) & 0x7f);
+        const int rotation = (int)((settings >> 14) & 0x3f);
+        const auto algorithm = (MidiTools::EuclideanAlgorithm)((settings >> 20) & 1);
+        rhythmMask = MidiTools::rotateSteps(MidiTools::EuclideanTable::getInstance().getMask(hits, rhythmSteps, algorithm),
+                                            rhythmSteps, rotation);
+        rhythmPos = rhythmSteps > 0 ? rhythmPos % rhythmSteps : 0;
+    }
+
+    /** Rebuilds the chord in "Single note" mode when the followed scale or the single note has changed. */
+    void updateFollowedScale()
+    {
+        const auto* detector = followedDetector.load(std::memory_order_acquire);
+        const int note = singleNote.load(std::memory_order_relaxed);
+        if (detector == nullptr || chordMethod != 2 || ! juce::isPositiveAndBelow(note, 128))
+        {
+            appliedScaleKey = 0;
+            return;
+        }
+
+        const auto match = detector->getMatch();
+        if (! match.isValid())
+            return;
+
+        const bool chordMode = followedChordMode.load(std::memory_order_relaxed);
+        const auto key = 1u | (juce::uint32)match.root << 1 | (juce::uint32)match.type << 5
+                            | (juce::uint32)note << 10 | (chordMode ? 1u << 17 : 0u);
+        if (key == appliedScaleKey)
+            return;
+
+        appliedScaleKey = key;
+        chord = MidiTools::getDiatonicChordValue(match.root, match.type,
+                                                 MidiTools::getScaleDegree(match.root, match.type, note), chordMode);
+        updateDegreeTable();
+    }
+
+    /**
+        Swaps in any state published by the setters. Called by the audio thread before it
+        reads the chord or pattern; wait-free and allocation-free.
+    */
+    void applyPendingChanges()
+    {
+        const int method = publishedChordMethod.load(std::memory_order_relaxed);
+        if (method != chordMethod)
+        {
+            chordMethod = method;
+            updateDegreeTable();
         }
 
-        juce::Array<int> presentDegrees;
-        const auto& degrees = chord.getDegrees();
-        for (int i = 0; i < degrees.size(); ++i)
+        updateRhythm();
+        updateFollowedScale();
+
+        auto* changes = pendingChanges.exchange(nullptr, std::memory_order_acq_rel);
+        if (changes == nullptr)
+            return;
+        ++numAppliedChanges;
+
+        if (changes->hasChord)
         {
-            if (degrees[i] != -1)
-                presentDegrees.add(i);
+            std::swap(chord, changes->chord);
+            appliedScaleKey = 0; // A followed scale takes over again on the next block.
         }
+        if (changes->hasPattern)
+        {
+            std::swap(pattern, changes->pattern);
+            std::swap(compiledPattern, changes->compiledPattern);
+            playState->pos = 0;
+            playState->octave = baseOctave; // Reset octave on pattern change for a clean start.
+            notesNeedRelease = true;
+        }
+        if (changes->hasPlayNoteOff)
+            playNoteOff = changes->playNoteOff;
+        if (changes->hasChord || changes->hasPlayNoteOff)
+            updateDegreeTable();
+
+        // Hand the replaced state back for deletion off the audio thread. At most one
+        // change set is retired per publish and the publisher drains the FIFO first,
+        // so it cannot fill up.
+        int start1, size1, start2, size2;
+        retiredFifo.prepareToWrite(1, start1, size1, start2, size2);
+        jassert(size1 + size2 == 1);
+        if (size1 > 0) retiredChanges[(size_t)start1] = changes;
+        else if (size2 > 0) retiredChanges[(size_t)start2] = changes;
+        retiredFifo.finishedWrite(size1 + size2);
+    }
 
-        if (presentDegrees.isEmpty())
+    /**
+        Returns the index of the ']' or '}' closing a chord step opened at openPos, or -1 if
+        openPos does not open one. Chord steps never wrap around the end of the pattern.
+    */
+    static int findClosingBracket(const juce::Array<char>& chars, int openPos)
+    {
+        const char open = chars[openPos];
+        if (open != '[' && open != '{')
             return -1;
 
-        return presentDegrees[juce::Random::getSystemRandom().nextInt(presentDegrees.size())];
+        const char closing = (open == '[') ? ']' : '}';
+        for (int i = openPos + 1; i < chars.size(); ++i)
+            if (chars[i] == closing)
+                return i;
+        return -1;
+    }
+
+    /**
+        Scans the pattern once to build the step <-> character index tables used by
+        numSteps(), getPatternIndexForStep() and getStepForPatternIndex().
+        Prefixes and their arguments belong to the step of the note command they precede.
+    */
+    static void buildStepTables(const juce::Array<char>& chars, CompiledPattern& result)
+    {
+        const int length = chars.size();
+        auto& patternIndexForStep = result.patternIndexForStep;
+        auto& stepForPatternIndex = result.stepForPatternIndex;
+        patternIndexForStep.clearQuick();
+        stepForPatternIndex.clearQuick();
+        stepForPatternIndex.insertMultiple(0, 0, length + 1);
+
+        int steps = 0;
+        int i = 0;
+        while (i < length)
+        {
+            // The first character index reached while 'steps' steps have been seen starts the next step.
+            if (patternIndexForStep.size() == steps)
+                patternIndexForStep.add(i);
+
+            const char command = chars[i];
+            const int closingPos = findClosingBracket(chars, i);
+            int consumed = 1;
+            if (closingPos != -1)
+            {
+                consumed = closingPos - i + 1; // A chord step and its degrees
+                steps++;
+            }
+            else if (command == 'o' || command == 'O' || command == 'v' || command == 'V' || command == 'g')
+            {
+                consumed = 2; // Skip the command and its argument
+            }
+            else if (juce::CharacterFunctions::isDigit(command) || command == '+' ||
+                     command == '-' || command == '?' || command == '"' ||
+                     command == '=' || command == '.' || command == '_')
+            {
+                steps++; // This is a valid step command
+            }
+
+            // Every index up to the next scanned character sees the updated count.
+            for (int j = i + 1; j <= juce::jmin(length, i + consumed); ++j)
+                stepForPatternIndex.set(j, steps);
+            i += consumed;
+        }
+
+        result.numSteps = steps;
+    }
+
+    /**
+        Compiles the pattern string into one PatternStep per character index, so that
+        whatever position the arpeggiator is at, the next step is a single array fetch.
+        The parse mirrors the original character-by-character interpretation, including
+        prefixes wrapping around the end of the pattern.
+    */
+    static void compilePattern(const juce::String& source, CompiledPattern& result)
+    {
+        auto& compiledSteps = result.steps;
+        compiledSteps.clearQuick();
+
+        juce::Array<char> chars;
+        for (auto p = source.getCharPointer(); ! p.isEmpty();)
+        {
+            // Any non-ASCII character is neutral, as it always was; truncated to a char,
+            // e.g. U+0131 would become the command '1'.
+            const auto c = p.getAndAdvance();
+            chars.add(c < 0x80 ? (char)c : ' ');
+        }
+
+        const int length = chars.size();
+        buildStepTables(chars, result);
+        compiledSteps.ensureStorageAllocated(length);
+
+        for (int start = 0; start < length; ++start)
+        {
+            PatternStep step;
+            int p = start;
+            int commandPos = start;
+            int prefixCount = 0;
+            bool noteCommandFound = false;
+
+            struct OctaveModifier { bool global; char value; };
+            juce::Array<OctaveModifier> octaveModifiers;
+
+            // Same bounds as the original parser: give up after two passes over the pattern,
+            // and bail out if the prefixes alone loop around the pattern (e.g. "##").
+            for (int i = 0; i < length * 2 && ! noteCommandFound && prefixCount <= length * 2; ++i)
+            {
+                while (prefixCount <= length * 2)
+                {
+                    const char command = chars[p];
+                    commandPos = p;
+
+                    if (command == 'o' || command == 'O')
+                    {
+                        const char octaveCommand = chars[(p + 1) % length];
+                        octaveModifiers.add({ command == 'O', octaveCommand });
+                        p = (p + 2) % length;
+                        prefixCount += 2;
+                    }
+                    else if (command == 'v' || command == 'V')
+                    {
+                        const char velocityValueChar = chars[(p + 1) % length];
+                        if (juce::CharacterFunctions::isDigit(velocityValueChar))
+                        {
+                            const int velocity = juce::jmin(127, (velocityValueChar - '0') * 16);
+                            if (command == 'v') step.localVelocity = (juce::int16)velocity;
+                            else step.globalVelocity = (juce::int16)velocity;
+                        }
+                        p = (p + 2) % length;
+                        prefixCount += 2;
+                    }
+                    else if (command == 'g')
+                    {
+                        const char gateValueChar = chars[(p + 1) % length];
+                        if (juce::CharacterFunctions::isDigit(gateValueChar))
+                            step.gateQuarters = (juce::int8)(gateValueChar - '0');
+                        p = (p + 2) % length;
+                        prefixCount += 2;
+                    }
+                    else if (command == '#' || command == 'b')
+                    {
+                        step.semitoneOffset = (command == '#') ? 1 : -1;
+                        p = (p + 1) % length;
+                        ++prefixCount;
+                    }
+                    else
+                    {
+                        break;
+                    }
+                }
+
+                if (prefixCount > length * 2)
+                    break;
+
+                const char command = chars[p];
+                commandPos = p;
+                p = (p + 1) % length;
+
+                noteCommandFound = true;
+                if (command == '_')                                   step.op = PatternStep::sustain;
+                else if (command > '0' && command <= '9')           { step.op = PatternStep::degree; step.degreeIndex = (juce::int8)(command - '1'); }
+                else if (command == '+')                              step.op = PatternStep::next;
+                else if (command == '-')                              step.op = PatternStep::previous;
+                else if (command == '?')                              step.op = PatternStep::random;
+                else if (command == '.')                              step.op = PatternStep::rest;
+                else if (command == '0' || command == '=' || command == '"') step.op = PatternStep::repeat;
+                else if (const int closingPos = findClosingBracket(chars, commandPos); closingPos != -1)
+                {
+                    for (int k = commandPos + 1; k < closingPos; ++k)
+                        if (chars[k] > '0' && chars[k] <= '9' && step.numChordDegrees < PatternStep::maxChordDegrees)
+                            step.chordDegrees[step.numChordDegrees++] = (juce::int8)(chars[k] - '1');
+                    step.op = step.numChordDegrees > 0 ? PatternStep::chord : PatternStep::rest;
+                    step.strum = command == '{';
+                    p = (closingPos + 1) % length;
+                }
+                else noteCommandFound = false; // Ignore invalid characters (like spaces) and continue.
+            }
+
+            step.hasNoteCommand = noteCommandFound;
+
+            // Resolve the octave prefixes for every global octave the step may be entered with.
+            step.hasOctaveModifiers = ! octaveModifiers.isEmpty();
+            for (int entryOctave = 0; entryOctave < PatternStep::numOctaves; ++entryOctave)
+            {
+                int localOctave = -1;
+                int globalOctave = entryOctave;
+                for (const auto& modifier : octaveModifiers)
+                {
+                    const int currentStepOctave = (localOctave != -1) ? localOctave : globalOctave;
+                    int targetOctave = currentStepOctave;
+                    if (modifier.value == '+') targetOctave = juce::jmin(7, currentStepOctave + 1);
+                    else if (modifier.value == '-') targetOctave = juce::jmax(0, currentStepOctave - 1);
+                    else if (juce::CharacterFunctions::isDigit(modifier.value)) targetOctave = modifier.value - '0';
+
+                    if (modifier.global) globalOctave = targetOctave;
+                    else localOctave = targetOctave;
+                }
+                step.localOctave[entryOctave] = (juce::int8)localOctave;
+                step.globalOctave[entryOctave] = (juce::int8)globalOctave;
+            }
+
+            step.stepIndex = result.stepForPatternIndex.getUnchecked(commandPos);
+            step.nextPos = p;
+            compiledSteps.add(step);
+        }
+
+        // Count the sustains that follow each step, for notes whose note-off is scheduled.
+        for (auto& step : compiledSteps)
+        {
+            int next = step.nextPos;
+            int count = 0;
+            while (count < length && compiledSteps.getReference(next).op == PatternStep::sustain)
+            {
+                next = compiledSteps.getReference(next).nextPos;
+                ++count;
+            }
+            step.numSustainSteps = (juce::int16)count;
+        }
     }
 
-    MidiTools::Chord chord;
+    /**
+        Compiled patterns shared by arpeggiators playing the same pattern string, so that
+        an ArpeggiatorBank holds one copy of each pattern rather than one per lane.
+        Only the threads calling the setters use it; the last arpeggiator to drop a pattern
+        does so when its retired changes are released, never on the audio thread.
+    */
+    class PatternCache
+    {
+    public:
+        /** Returns the compiled pattern, compiling it only if no arpeggiator holds it yet. */
+        std::shared_ptr<const CompiledPattern> get(const juce::String& source)
+        {
+            const juce::ScopedLock sl(lock);
+            for (auto it = patterns.begin(); it != patterns.end();)
+                it = it->second.expired() ? patterns.erase(it) : std::next(it);
+
+            auto& entry = patterns[source];
+            if (auto shared = entry.lock())
+                return shared;
+
+            auto compiled = std::make_shared<CompiledPattern>();
+            compilePattern(source, *compiled);
+            entry = compiled;
+            return compiled;
+        }
+
+        /** Returns the number of distinct patterns held. */
+        int getNumPatterns() const
+        {
+            const juce::ScopedLock sl(lock);
+            return (int)std::count_if(patterns.begin(), patterns.end(), [](const auto& p) { return ! p.second.expired(); });
+        }
+
+    private:
+        juce::CriticalSection lock;
+        std::map<juce::String, std::weak_ptr<const CompiledPattern>> patterns;
+    };
+
+    /** Compiles a pattern for publishing, or shares it through the pattern cache. */
+    std::shared_ptr<const CompiledPattern> compileShared(const juce::String& source) const
+    {
+        if (patternCache != nullptr)
+            return patternCache->get(source);
+
+        auto compiled = std::make_shared<CompiledPattern>();
+        compilePattern(source, *compiled);
+        return compiled;
+    }
+
+    /**
+        Makes later patterns come from the cache, and shares the current one. Call it before
+        playback, not while the audio thread may be in processBlock().
+    */
+    void setPatternCache(PatternCache* cache)
+    {
+        patternCache = cache;
+        if (patternCache != nullptr)
+            compiledPattern = patternCache->get(pattern);
+    }
+
+    PatternCache* patternCache = nullptr; // Before the compiled pattern, which the constructors build through it.
+    MidiTools::ChordValue chord; // Audio-thread copy; trivially copyable.
     juce::String pattern;
+    std::shared_ptr<const CompiledPattern> compiledPattern; // Replaced, never modified: lanes of an ArpeggiatorBank share it.
     int baseOctave = 4;
-    int octave = baseOctave;
-    juce::String playNoteOff = "Next"; // "Off", "Next", "Previous"
-    int chordMethod = 0; // 0: Notes played, 1: Chord played as is, 2: Single note
-    int globalVelocity = 96; // Default velocity
+    PlayNoteOffMode playNoteOff = PlayNoteOffMode::next;
+    int chordMethod = 0; // 0: Notes played, 1: Chord played as is, 2: Single note. Audio-thread copy.
+    std::atomic<int> publishedChordMethod { 0 }; // Set by setChordMethod(), read once per block.
 
-    int pos = 0;
-    int lastPlayedMidiNote = -1;
-    int lastPlayedMidiChannel = 1;
-    int lastPlayedDegreeIndex = 0;
-    int currentStepIndex = 0;
+    /** Where the pattern has got to and what it last played. */
+    struct PlayState
+    {
+        int pos = 0;
+        int octave = 4;
+        int globalVelocity = 96; // Default velocity
+        int lastPlayedMidiNote = -1;
+        int lastPlayedDegreeIndex = 0;
+        int currentStepIndex = 0;
+    };
+    PlayState ownPlayState;
+    PlayState* playState = &ownPlayState; // An ArpeggiatorBank keeps those of all its lanes together.
+
+    // Degree indices 0-15 cover every pattern digit, '+'/'-' wrap and '?' pick.
+    static constexpr int degreeTableSize = 16;
+    std::array<int, degreeTableSize> noteForDegree {};
+    std::array<int, MidiTools::ChordValue::maxDegrees> presentDegrees {};
+    int numPresentDegrees = 0;
+    std::atomic<bool> degreeTableDirty { true };
+
+    /** A sounding note. Held voices end at the next note command, the others have a scheduled note-off. */
+    struct Voice
+    {
+        int note = 0;
+        int channel = 1;
+        bool held = true;
+    };
+
+    /** A note-off (velocity 0) or a delayed note-on of a strummed chord, at an absolute sample time. */
+    struct ScheduledEvent
+    {
+        juce::int64 time = 0;
+        int note = 0;
+        int channel = 1;
+        juce::uint8 velocity = 0;
+        double lengthInSamples = 0.0; // For note-ons: see startNote().
+    };
+
+    static constexpr int maxVoices = 64;
+    std::array<Voice, maxVoices> voices {}; // Oldest first.
+    int numVoices = 0;
+    bool notesNeedRelease = false; // Set when a pattern change is applied.
+    juce::uint32 numAppliedChanges = 0; // Change sets picked up, so that ArpeggiatorBank sees when a lane changed.
+
+    static constexpr int maxScheduledEvents = 256;
+    MidiTools::TimedEventQueue<ScheduledEvent, maxScheduledEvents> scheduledEvents;
+    juce::int64 sampleTime = 0; // Samples processed so far; the start of the current block.
+    std::atomic<float> gate { 1.0f };
+    std::atomic<float> strumTime { 20.0f }; // Milliseconds between the notes of a '{...}' step.
+
+    // Euclidean gating: setEuclideanRhythm() packs hits, steps, rotation and algorithm into one word.
+    std::atomic<juce::uint32> rhythmSettings { 0 };
+    juce::uint32 appliedRhythmSettings = 0; // Audio-thread copy of the settings behind rhythmMask.
+    juce::uint64 rhythmMask = 0;            // Bit i set when step i of the rhythm is a hit.
+    int rhythmSteps = 0;                    // 0 when there is no rhythm.
+    int rhythmPos = 0;
+
+    // Scale following in "Single note" mode, see followScale().
+    std::atomic<const MidiTools::ScaleDetector*> followedDetector { nullptr };
+    std::atomic<bool> followedChordMode { false };
+    std::atomic<int> singleNote { -1 };
+    juce::uint32 appliedScaleKey = 0; // Detected scale, note and mode behind the current chord; 0 if none.
+
+    MidiTools::FastRandom stepRandom;    // For '?' steps, on the audio thread.
+    MidiTools::FastRandom patternRandom; // For makeRandomPattern(), on the calling thread.
+
+    // Setter-side copies, so the getters never touch the audio thread's state.
+    MidiTools::Chord publishedChord;
+    juce::String publishedPattern;
+
+    std::atomic<PendingChanges*> pendingChanges { nullptr };
+    static constexpr int retiredCapacity = 8;
+    juce::AbstractFifo retiredFifo { retiredCapacity };
+    std::array<PendingChanges*, retiredCapacity> retiredChanges {};
 
 private:
     double getNoteDivisor() const
     {
-        switch (subdivision)
-        {
-            case 0: return 1.0;  // 1/4
-            case 1: return 1.5;  // 1/4T
-            case 2: return 2.0;  // 1/8
-            case 3: return 3.0;  // 1/8T
-            case 4: return 4.0;  // 1/16
-            case 5: return 6.0;  // 1/16T
-            case 6: return 8.0;  // 1/32
-            case 7: return 12.0; // 1/32T
-            case 8: return 16.0; // 1/64
-            case 9: return 24.0; // 1/64T
-            default: return 4.0;
-        }
+        return getNoteDivisor(subdivision);
     }
 
     void updateSamplesPerNote()
@@ -832,8 +1794,583 @@ private:
         }
     }
     double sampleRate = 0.0;
+    int maxBlockSize = 0;
     double tempoBPM = 120.0;
     int subdivision = 4; // Default to 1/16
     double samplesPerNote = 0.0;
     double samplesUntilNextNote = 0.0;
+
+    friend class ArpeggiatorBank;
+    friend class ArpeggiatorRenderer;
+};
+
+/**
+    A transport shared by many arpeggiators.
+
+    Each Arpeggiator normally keeps its own countdown to the next step. When many of them
+    follow the same host tempo, an ArpClock computes the step boundaries of each subdivision
+    once per block and plays every subscribed arpeggiator at those offsets with
+    Arpeggiator::processSteps(). Arpeggiators with the same subdivision are thereby
+    phase-locked; the timing is the same as each of them running processBlock() alone.
+
+    Subscribed arpeggiators still need their own prepareToPlay(); the clock sets their tempo.
+    subscribe(), unsubscribe() and the other methods must be called from the audio thread,
+    or while it is not processing. Subscribers are kept in a fixed table of maxSubscribers,
+    so subscribing and unsubscribing never allocate.
+*/
+class ArpClock
+{
+public:
+    /**
+        Call this before playback, from the message thread.
+        @param maximumBlockSize The largest block size processBlock() will be called with.
+    */
+    void prepareToPlay(double rate, int maximumBlockSize)
+    {
+        sampleRate = rate;
+        for (auto& offsets : stepOffsets)
+            offsets.ensureStorageAllocated(juce::jmax(1, maximumBlockSize)); // Steps are at least one sample apart.
+        updateSamplesPerStep();
+    }
+
+    void setTempo(double newTempoBPM)
+    {
+        tempoBPM = newTempoBPM > 0 ? newTempoBPM : 120.0;
+        updateSamplesPerStep();
+    }
+
+    double getTempo() const { return tempoBPM; }
+
+    static constexpr int maxSubscribers = 256;
+
+    /**
+        Adds an arpeggiator, playing on the given MIDI channel. The arpeggiator must outlive its subscription.
+        @return false if maxSubscribers arpeggiators are already subscribed.
+    */
+    bool subscribe(Arpeggiator& arpeggiator, int midiChannel = 1)
+    {
+        unsubscribe(arpeggiator);
+        jassert(numSubscribers < maxSubscribers);
+        if (numSubscribers >= maxSubscribers)
+            return false;
+
+        subscribers[(size_t)numSubscribers++] = { &arpeggiator, midiChannel };
+        return true;
+    }
+
+    void unsubscribe(Arpeggiator& arpeggiator)
+    {
+        const auto end = subscribers.begin() + numSubscribers;
+        numSubscribers = (int)(std::remove_if(subscribers.begin(), end, [&arpeggiator](const Subscriber& s)
+                                              { return s.arpeggiator == &arpeggiator; })
+                               - subscribers.begin());
+    }
+
+    int getNumSubscribers() const { return numSubscribers; }
+
+    /** Preallocates a buffer large enough for the output of every subscribed arpeggiator. */
+    void prepareMidiBuffer(juce::MidiBuffer& buffer) const
+    {
+        size_t bytes = 0;
+        for (int i = 0; i < numSubscribers; ++i)
+            bytes += subscribers[(size_t)i].arpeggiator->getMaxMidiBytesPerBlock();
+        buffer.ensureSize(bytes);
+    }
+
+    /** Makes the next block start with a step in every subdivision. */
+    void reset()
+    {
+        samplesUntilNextStep.fill(0.0);
+    }
+
+    /**
+        Aligns every subdivision's next step with the host's transport position, as
+        Arpeggiator::syncToPlayHead() does for a single arpeggiator.
+    */
+    void syncToPlayHead(const juce::AudioPlayHead::CurrentPositionInfo& positionInfo)
+    {
+        if (sampleRate <= 0.0 || positionInfo.ppqPosition < 0.0)
+            return;
+
+        for (int i = 0; i < Arpeggiator::numSubdivisions; ++i)
+        {
+            const double stepDurationPPQ = 1.0 / Arpeggiator::getNoteDivisor(i);
+            const double songPosInSteps = positionInfo.ppqPosition / stepDurationPPQ;
+            const double stepsUntilNext = std::ceil(songPosInSteps) - songPosInSteps;
+            const double ppqUntilNext = stepsUntilNext * stepDurationPPQ;
+            const double secondsPerPPQ = 60.0 / (tempoBPM * 1.0); // 1.0 is quarter note
+            samplesUntilNextStep[(size_t)i] = ppqUntilNext * secondsPerPPQ * sampleRate;
+        }
+    }
+
+    /**
+        Computes this block's step boundaries and plays every subscribed arpeggiator,
+        appending their events to midiOut. Does not allocate once prepareToPlay() and
+        prepareMidiBuffer() have been called.
+    */
+    void processBlock(juce::MidiBuffer& midiOut, int numSamples)
+    {
+        for (int i = 0; i < Arpeggiator::numSubdivisions; ++i)
+            computeStepOffsets(i, numSamples);
+
+        for (int i = 0; i < numSubscribers; ++i)
+        {
+            const auto& s = subscribers[(size_t)i];
+            auto& arpeggiator = *s.arpeggiator;
+            if (arpeggiator.getTempo() != tempoBPM)
+                arpeggiator.setTempo(tempoBPM);
+
+            const auto& offsets = stepOffsets[(size_t)getSubdivisionIndex(arpeggiator.getSubdivision())];
+            arpeggiator.processSteps(midiOut, numSamples, offsets.getRawDataPointer(), offsets.size(), s.midiChannel);
+        }
+    }
+
+    /** Returns the sample offsets of the steps of a subdivision in the last processed block. */
+    const juce::Array<int>& getStepOffsets(int subdivisionIndex) const
+    {
+        return stepOffsets[(size_t)getSubdivisionIndex(subdivisionIndex)];
+    }
+
+private:
+    struct Subscriber
+    {
+        Arpeggiator* arpeggiator = nullptr;
+        int midiChannel = 1;
+    };
+
+    /** Maps out-of-range indices to 1/16, like Arpeggiator::getNoteDivisor(). */
+    static int getSubdivisionIndex(int subdivisionIndex)
+    {
+        return juce::isPositiveAndBelow(subdivisionIndex, Arpeggiator::numSubdivisions) ? subdivisionIndex : 4;
+    }
+
+    /** Runs the countdown of Arpeggiator::processBlock() for one subdivision, recording each step. */
+    void computeStepOffsets(int subdivisionIndex, int numSamples)
+    {
+        auto& offsets = stepOffsets[(size_t)subdivisionIndex];
+        auto& samplesUntilNext = samplesUntilNextStep[(size_t)subdivisionIndex];
+        const double samplesPerNote = samplesPerStep[(size_t)subdivisionIndex];
+        offsets.clearQuick();
+
+        if (samplesPerNote <= 0.0)
+            return;
+
+        int time = 0;
+        while (time < numSamples)
+        {
+            if (samplesUntilNext <= 0.0)
+            {
+                offsets.add(time);
+                while (samplesUntilNext <= 0.0)
+                    samplesUntilNext += samplesPerNote;
+            }
+
+            const int samplesToAdvance = (int)std::ceil(samplesUntilNext);
+            const int samplesThisStep = juce::jmin(numSamples - time, juce::jmax(1, samplesToAdvance));
+
+            time += samplesThisStep;
+            samplesUntilNext -= samplesThisStep;
+        }
+    }
+
+    void updateSamplesPerStep()
+    {
+        for (int i = 0; i < Arpeggiator::numSubdivisions; ++i)
+        {
+            if (sampleRate > 0 && tempoBPM > 0)
+            {
+                const double noteDivisor = Arpeggiator::getNoteDivisor(i);
+                double quarterNoteDurationSeconds = 60.0 / tempoBPM;
+                samplesPerStep[(size_t)i] = sampleRate * quarterNoteDurationSeconds / noteDivisor;
+            }
+        }
+    }
+
+    std::array<Subscriber, maxSubscribers> subscribers {}; // In subscription order.
+    int numSubscribers = 0;
+    std::array<juce::Array<int>, Arpeggiator::numSubdivisions> stepOffsets;
+    std::array<double, Arpeggiator::numSubdivisions> samplesPerStep {};
+    std::array<double, Arpeggiator::numSubdivisions> samplesUntilNextStep {};
+    double sampleRate = 0.0;
+    double tempoBPM = 120.0;
+};
+
+/**
+    A fixed set of arpeggiator lanes advanced together, for installations running hundreds of them.
+
+    Most blocks contain neither a step nor a scheduled event for a given lane. The bank keeps
+    what decides this (each lane's countdown, next scheduled event and pending-edit flag) in
+    contiguous arrays, and advances such lanes in one tight loop without touching their
+    Arpeggiator objects. The other lanes run exactly the code of Arpeggiator::processBlock(),
+    so the output is bit-identical to that of independent arpeggiators. Their play state
+    (position, octave, velocity and last note) is also kept in one array, and lanes playing
+    the same pattern string share a single compiled copy of it.
+
+    Lanes are configured through editLane(), which lets the bank notice the change; getLane()
+    only gives read access. Setters that are thread-safe on an Arpeggiator remain so here.
+*/
+class ArpeggiatorBank
+{
+public:
+    explicit ArpeggiatorBank(int numLanes)
+        : playStates((size_t)juce::jmax(0, numLanes)),
+          samplesUntilNextStep((size_t)juce::jmax(0, numLanes), 0.0),
+          nextEventTime((size_t)juce::jmax(0, numLanes), noEvent),
+          skippedSamples((size_t)juce::jmax(0, numLanes), 0),
+          midiChannels((size_t)juce::jmax(0, numLanes), 1),
+          playable((size_t)juce::jmax(0, numLanes), 0),
+          edited(new std::atomic<bool>[(size_t)juce::jmax(0, numLanes)])
+    {
+        for (int i = 0; i < numLanes; ++i)
+        {
+            lanes.push_back(std::make_unique<Arpeggiator>());
+            auto& lane = *lanes.back();
+            lane.setPatternCache(&patternCache);
+            playStates[(size_t)i] = lane.ownPlayState;
+            lane.playState = &playStates[(size_t)i];
+            edited[(size_t)i].store(true);
+        }
+    }
+
+    int getNumLanes() const { return (int)lanes.size(); }
+
+    /** Read access to a lane, e.g. for getPattern() or getCurrentStepIndex(). */
+    const Arpeggiator& getLane(int lane) const { return *lanes[(size_t)lane]; }
+
+    /** Returns the number of distinct compiled patterns the lanes share. */
+    int getNumPatterns() const { return patternCache.getNumPatterns(); }
+
+    /**
+        Changes a lane, e.g. editLane(3, [](Arpeggiator& a) { a.setPattern("[135]_"); }).
+        The change is picked up at the start of the next block, as for a single arpeggiator.
+        Do not change the lane's countdown here (setSamplesUntilNextNote()); the bank owns it.
+        Nor its sample rate, and keep its tempo within the maximum given to prepareToPlay(),
+        as prepareMidiBuffer() relies on both.
+    */
+    template <typename Function>
+    void editLane(int lane, Function&& edit)
+    {
+        edit(*lanes[(size_t)lane]);
+        edited[(size_t)lane].store(true, std::memory_order_release);
+    }
+
+    /** Sets the MIDI channel a lane plays on. Call from the audio thread or while stopped. */
+    void setMidiChannel(int lane, int midiChannel)
+    {
+        midiChannels[(size_t)lane] = (midiChannel < 1 || midiChannel > 16) ? 1 : midiChannel;
+    }
+
+    /**
+        Prepares every lane. See Arpeggiator::prepareToPlay().
+        @param maximumTempoBPM The fastest tempo setTempo() will be given, which bounds the
+                               number of steps per block that prepareMidiBuffer() allows for.
+    */
+    void prepareToPlay(double rate, int maximumBlockSize, double maximumTempoBPM = 999.0)
+    {
+        sampleRate = rate;
+        maxBlockSize = juce::jmax(0, maximumBlockSize);
+        maxTempoBPM = maximumTempoBPM;
+        for (int i = 0; i < getNumLanes(); ++i)
+            editLane(i, [&](Arpeggiator& a) { a.prepareToPlay(rate, maximumBlockSize); });
+    }
+
+    /** Sets the tempo of every lane, at most the maximum given to prepareToPlay(). */
+    void setTempo(double newTempoBPM)
+    {
+        jassert(newTempoBPM <= maxTempoBPM); // Or the buffer from prepareMidiBuffer() may be too small.
+        for (int i = 0; i < getNumLanes(); ++i)
+            editLane(i, [newTempoBPM](Arpeggiator& a) { a.setTempo(newTempoBPM); });
+    }
+
+    /**
+        Preallocates a buffer large enough for the output of every lane, in blocks of up to
+        the prepared size and at tempos up to the prepared maximum.
+    */
+    void prepareMidiBuffer(juce::MidiBuffer& buffer) const
+    {
+        const int maxSteps = Arpeggiator::getMaxStepsPerBlock(sampleRate, maxBlockSize, maxTempoBPM);
+        buffer.ensureSize(lanes.size() * Arpeggiator::getMaxMidiBytesForSteps(maxSteps));
+    }
+
+    /** Returns the number of samples remaining until a lane's next step. */
+    double getSamplesUntilNextNote(int lane) const
+    {
+        return samplesUntilNextStep[(size_t)lane];
+    }
+
+    /** Generates the events of every lane for this block, appending them to midiOut. */
+    void processBlock(juce::MidiBuffer& midiOut, int numSamples)
+    {
+        const juce::int64 blockEnd = blockStart + numSamples;
+
+        for (size_t i = 0; i < lanes.size(); ++i)
+        {
+            // A lane with no edit, no step and no event due in this block only needs its
+            // countdown advanced, exactly as Arpeggiator::processBlock() would.
+            const double untilNext = samplesUntilNextStep[i];
+            if (nextEventTime[i] >= blockEnd
+                && ! edited[i].load(std::memory_order_acquire)
+                && (! playable[i] || (untilNext > 0.0 && std::ceil(untilNext) >= numSamples)))
+            {
+                if (playable[i])
+                    samplesUntilNextStep[i] = untilNext - numSamples;
+                skippedSamples[i] += numSamples;
+                continue;
+            }
+
+            processLane(i, midiOut, numSamples);
+        }
+
+        blockStart = blockEnd;
+    }
+
+    /** Aligns every lane with the host's transport position. See Arpeggiator::syncToPlayHead(). */
+    void syncToPlayHead(const juce::AudioPlayHead::CurrentPositionInfo& positionInfo)
+    {
+        for (size_t i = 0; i < lanes.size(); ++i)
+        {
+            auto& lane = catchUp(i);
+            const auto changesBefore = lane.numAppliedChanges;
+            lane.syncToPlayHead(positionInfo);
+            storeLaneState(i, lane.numAppliedChanges != changesBefore);
+        }
+    }
+
+    /** Resets every lane, appending their note-offs to midiOut at sample 0. See Arpeggiator::reset(). */
+    void reset(juce::MidiBuffer& midiOut, const juce::Optional<juce::AudioPlayHead::CurrentPositionInfo> positionInfo = {})
+    {
+        for (size_t i = 0; i < lanes.size(); ++i)
+        {
+            auto& lane = catchUp(i);
+            const auto changesBefore = lane.numAppliedChanges;
+            lane.reset(midiOut, midiChannels[i], positionInfo);
+            storeLaneState(i, lane.numAppliedChanges != changesBefore);
+        }
+    }
+
+    /** Turns every lane off, appending their note-offs to midiOut at sample 0. See Arpeggiator::turnOff(). */
+    void turnOff(juce::MidiBuffer& midiOut)
+    {
+        for (size_t i = 0; i < lanes.size(); ++i)
+        {
+            auto& lane = catchUp(i);
+            const auto changesBefore = lane.numAppliedChanges;
+            lane.turnOff(midiOut, midiChannels[i]);
+            storeLaneState(i, lane.numAppliedChanges != changesBefore);
+        }
+    }
+
+private:
+    static constexpr juce::int64 noEvent = std::numeric_limits<juce::int64>::max();
+
+    /** Brings a lane's clock and countdown up to date before calling into it. */
+    Arpeggiator& catchUp(size_t i)
+    {
+        auto& lane = *lanes[i];
+        lane.sampleTime += skippedSamples[i];
+        skippedSamples[i] = 0;
+        lane.samplesUntilNextNote = samplesUntilNextStep[i];
+        return lane;
+    }
+
+    /**
+        Reads back what the fast path of processBlock() needs after calling into a lane.
+        @param pickedUpChanges Whether the call applied published changes, which may have made
+                               the lane playable or due to release its notes: its next block
+                               must then run in full.
+    */
+    void storeLaneState(size_t i, bool pickedUpChanges)
+    {
+        const auto& lane = *lanes[i];
+        samplesUntilNextStep[i] = lane.samplesUntilNextNote;
+        nextEventTime[i] = lane.scheduledEvents.isEmpty() ? noEvent : lane.scheduledEvents.top().time;
+        if (pickedUpChanges)
+            edited[i].store(true, std::memory_order_release);
+    }
+
+    /** Arpeggiator::processBlock() for one lane, with the countdown kept in the bank. */
+    void processLane(size_t i, juce::MidiBuffer& midiOut, int numSamples)
+    {
+        edited[i].store(false, std::memory_order_relaxed);
+        auto& lane = catchUp(i);
+
+        if (! lane.beginBlock(midiOut, numSamples))
+        {
+            playable[i] = 0;
+            nextEventTime[i] = lane.scheduledEvents.isEmpty() ? noEvent : lane.scheduledEvents.top().time;
+            return;
+        }
+        playable[i] = 1;
+
+        const int midiChannel = midiChannels[i];
+        const double samplesPerNote = lane.samplesPerNote;
+        double untilNext = samplesUntilNextStep[i];
+
+        int time = 0;
+        while (time < numSamples)
+        {
+            if (untilNext <= 0.0)
+            {
+                lane.releaseDueEvents(midiOut, time); // Note-offs falling on this sample go before the note-on.
+                lane.getNext(midiOut, time, midiChannel);
+                while (untilNext <= 0.0)
+                    untilNext += samplesPerNote;
+            }
+
+            const int samplesToAdvance = (int)std::ceil(untilNext);
+            const int samplesThisStep = juce::jmin(numSamples - time, juce::jmax(1, samplesToAdvance));
+
+            time += samplesThisStep;
+            untilNext -= samplesThisStep;
+        }
+
+        lane.releaseDueEvents(midiOut, numSamples - 1);
+        lane.sampleTime += numSamples;
+        lane.samplesUntilNextNote = untilNext;
+
+        samplesUntilNextStep[i] = untilNext;
+        nextEventTime[i] = lane.scheduledEvents.isEmpty() ? noEvent : lane.scheduledEvents.top().time;
+    }
+
+    Arpeggiator::PatternCache patternCache; // Outlives the lanes holding its patterns.
+    std::vector<Arpeggiator::PlayState> playStates; // Each lane's, in place of its own.
+    std::vector<std::unique_ptr<Arpeggiator>> lanes;
+
+    // Hot per-lane state, read for every lane on every block.
+    std::vector<double> samplesUntilNextStep;
+    std::vector<juce::int64> nextEventTime;  // Earliest scheduled event, in the lane's sample time.
+    std::vector<juce::int64> skippedSamples; // Samples advanced without calling into the lane.
+    std::vector<int> midiChannels;
+    std::vector<juce::uint8> playable;       // Whether the lane's last block got past beginBlock().
+    std::unique_ptr<std::atomic<bool>[]> edited;
+
+    juce::int64 blockStart = 0;
+    double sampleRate = 0.0;
+    int maxBlockSize = 0;
+    double maxTempoBPM = 999.0;
+};
+
+/**
+    Renders an arpeggiator over a chord timeline straight to a Standard MIDI File, much
+    faster than real time.
+
+    Time is counted in MIDI ticks instead of samples, and the arpeggiator jumps from one
+    step to the next instead of running through audio blocks. Events go directly to a
+    MidiTools::MidiFileWriter. Gates, strums and '?' steps behave as they do in real time;
+    call setRandomSeed() on the arpeggiator for reproducible renders.
+
+    Reuse one renderer for many files so that its buffers stay allocated.
+*/
+class ArpeggiatorRenderer
+{
+public:
+    /** A chord held from startPPQ for lengthPPQ quarter notes. */
+    struct ChordSpan
+    {
+        MidiTools::ChordValue chord;
+        double startPPQ = 0.0;
+        double lengthPPQ = 0.0;
+    };
+
+    explicit ArpeggiatorRenderer(int ticksPerQuarterNote = 960)
+        : writer(ticksPerQuarterNote)
+    {
+    }
+
+    /** The arpeggiator to configure before rendering: pattern, subdivision, gate, chord method, seed... */
+    Arpeggiator& getArpeggiator() { return arpeggiator; }
+
+    /**
+        Renders the timeline from PPQ 0 to the end of its last chord, then writes a type-0 MIDI
+        file. Notes still sounding at the end are ended there.
+        @param timeline  Chord spans sorted by start. Time not covered by any span is silent.
+        @return false if writing to the stream failed.
+    */
+    bool render(const juce::Array<ChordSpan>& timeline, double tempoBPM, juce::OutputStream& out, int midiChannel = 1)
+    {
+        if (midiChannel < 1 || midiChannel > 16) midiChannel = 1;
+        const double tempo = tempoBPM > 0 ? tempoBPM : 120.0;
+        const int ticksPerQuarter = writer.getTicksPerQuarterNote();
+
+        // One "sample" is one tick from here on.
+        arpeggiator.prepareToPlay(ticksPerQuarter * tempo / 60.0);
+        arpeggiator.setTempo(tempo);
+        arpeggiator.prepareMidiBuffer(stepBuffer);
+
+        writer.reset();
+        writer.addTempo(0, tempo);
+
+        // In place, so the note-offs of anything still sounding are written rather than dropped.
+        stepBuffer.clear();
+        arpeggiator.reset(stepBuffer, midiChannel);
+        arpeggiator.sampleTime = 0;
+        addToFile(0);
+
+        auto toTicks = [ticksPerQuarter](double ppq) { return (juce::int64)std::llround(ppq * ticksPerQuarter); };
+
+        juce::int64 endTick = 0;
+        for (const auto& span : timeline)
+            endTick = juce::jmax(endTick, toTicks(span.startPPQ + span.lengthPPQ));
+
+        const double ticksPerStep = ticksPerQuarter / Arpeggiator::getNoteDivisor(arpeggiator.getSubdivision());
+        int nextSpan = 0;
+        int currentSpan = -2; // Forces the first chord to be set.
+
+        for (juce::int64 step = 0;; ++step)
+        {
+            const auto tick = (juce::int64)std::llround((double)step * ticksPerStep);
+            if (tick >= endTick)
+                break;
+
+            // The chord of this step: the last span started, unless it has already ended.
+            while (nextSpan < timeline.size() && toTicks(timeline.getReference(nextSpan).startPPQ) <= tick)
+                ++nextSpan;
+            int span = nextSpan - 1;
+            if (span >= 0)
+            {
+                const auto& candidate = timeline.getReference(span);
+                if (toTicks(candidate.startPPQ + candidate.lengthPPQ) <= tick)
+                    span = -1;
+            }
+            if (span != currentSpan)
+            {
+                arpeggiator.setChord(span >= 0 ? timeline.getReference(span).chord : MidiTools::ChordValue());
+                currentSpan = span;
+            }
+
+            const auto nextTick = (juce::int64)std::llround((double)(step + 1) * ticksPerStep);
+            renderStep(tick, (int)juce::jmax((juce::int64)1, nextTick - tick), midiChannel);
+        }
+
+        stepBuffer.clear();
+        arpeggiator.releaseAllNotes(stepBuffer, 0);
+        addToFile(endTick);
+
+        return writer.writeTo(out, endTick);
+    }
+
+private:
+    /** Arpeggiator::processBlock() for a block holding exactly one step. */
+    void renderStep(juce::int64 tick, int numTicks, int midiChannel)
+    {
+        stepBuffer.clear();
+        if (arpeggiator.beginBlock(stepBuffer, numTicks))
+        {
+            arpeggiator.releaseDueEvents(stepBuffer, 0); // Note-offs falling on this tick go before the note-on.
+            arpeggiator.getNext(stepBuffer, 0, midiChannel);
+            arpeggiator.releaseDueEvents(stepBuffer, numTicks - 1);
+            arpeggiator.sampleTime += numTicks;
+        }
+        addToFile(tick);
+    }
+
+    void addToFile(juce::int64 tick)
+    {
+        for (const auto metadata : stepBuffer)
+            writer.addEvent(tick + metadata.samplePosition, metadata.data, metadata.numBytes);
+    }
+
+    Arpeggiator arpeggiator;
+    MidiTools::MidiFileWriter writer;
+    juce::MidiBuffer stepBuffer;
 };
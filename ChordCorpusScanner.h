@@ -0,0 +1,185 @@
+/*
+  ==============================================================================
+
+    ChordCorpusScanner.h
+    Created: 16 Oct 2026 3:47:12pm
+
+  ==============================================================================
+*/
+
+#pragma once
+
+#include "MidiTools.h"
+#include <JuceHeader.h>
+#include <atomic>
+#include <memory>
+#include <thread>
+#include <vector>
+
+/**
+    Runs a MidiTools::ChordTimelineAnalyser over a corpus of MIDI files on every core.
+
+    Each file is memory-mapped and parsed in place. Every thread reuses one analyser, so
+    after the first few files nothing is allocated per event. Files are distributed with
+    work stealing: each thread starts with an equal contiguous share of the list and,
+    once its share is done, takes files from the end of the other shares, so a few huge
+    files do not leave the other cores idle.
+
+    @code
+    juce::Array<juce::File> files;
+    for (const auto& entry : juce::RangedDirectoryIterator(corpusFolder, true, "*.mid;*.midi"))
+        files.add(entry.getFile());
+
+    ChordCorpusScanner scanner;
+    const auto result = scanner.writeTimelines(files); // song.mid -> song.chords
+    @endcode
+*/
+class ChordCorpusScanner
+{
+public:
+    struct Result
+    {
+        int numFiles = 0;            // Files analysed successfully.
+        int numFailed = 0;           // Files that could not be mapped, parsed or written.
+        juce::int64 numBytes = 0;    // Size of the files analysed.
+        juce::int64 numNoteOns = 0;
+        juce::int64 numEntries = 0;  // Timeline entries produced.
+    };
+
+    explicit ChordCorpusScanner(const MidiTools::ChordTimelineAnalyser::Options& analysisOptions = {})
+        : options(analysisOptions)
+    {
+    }
+
+    /**
+        Analyses every file and calls fileDone(fileIndex, analyser) for each one parsed
+        successfully, on the thread that analysed it: read the timeline from the analyser
+        before returning. fileDone must be thread-safe, and return false if it failed to
+        use the timeline, e.g. to write it; the file then counts as failed.
+        @param numThreads The number of threads to use; 0 uses one per core.
+    */
+    template <typename Callback>
+    Result scan(const juce::Array<juce::File>& files, Callback&& fileDone, int numThreads = 0) const
+    {
+        if (numThreads <= 0)
+            numThreads = (int)std::thread::hardware_concurrency();
+        numThreads = juce::jlimit(1, juce::jmax(1, files.size()), numThreads);
+
+        std::unique_ptr<WorkRange[]> ranges(new WorkRange[(size_t)numThreads]);
+        for (int i = 0; i < numThreads; ++i)
+            ranges[(size_t)i].set((int)((juce::int64)files.size() * i / numThreads),
+                                  (int)((juce::int64)files.size() * (i + 1) / numThreads));
+
+        std::vector<Result> results((size_t)numThreads);
+        auto work = [&](int thread)
+        {
+            MidiTools::ChordTimelineAnalyser analyser(options);
+            auto& result = results[(size_t)thread];
+
+            for (;;)
+            {
+                int index = ranges[(size_t)thread].takeFirst();
+                for (int other = 1; index < 0 && other < numThreads; ++other)
+                    index = ranges[(size_t)((thread + other) % numThreads)].takeLast();
+                if (index < 0)
+                    break;
+
+                const juce::MemoryMappedFile mapped(files.getReference(index), juce::MemoryMappedFile::readOnly);
+                if (mapped.getData() != nullptr
+                    && analyser.analyse(mapped.getData(), mapped.getSize())
+                    && fileDone(index, static_cast<const MidiTools::ChordTimelineAnalyser&>(analyser)))
+                {
+                    ++result.numFiles;
+                    result.numBytes += (juce::int64)mapped.getSize();
+                    result.numNoteOns += analyser.getNumNoteOns();
+                    result.numEntries += analyser.getTimeline().size();
+                }
+                else
+                {
+                    ++result.numFailed;
+                }
+            }
+        };
+
+        std::vector<std::thread> threads;
+        for (int thread = 1; thread < numThreads; ++thread)
+            threads.emplace_back(work, thread);
+        work(0);
+        for (auto& thread : threads)
+            thread.join();
+
+        Result total;
+        for (const auto& result : results)
+        {
+            total.numFiles += result.numFiles;
+            total.numFailed += result.numFailed;
+            total.numBytes += result.numBytes;
+            total.numNoteOns += result.numNoteOns;
+            total.numEntries += result.numEntries;
+        }
+        return total;
+    }
+
+    /**
+        Analyses every file and writes its timeline next to it, with the extension
+        replaced by ".chords" (see ChordTimelineAnalyser::writeTimeline() for the format).
+    */
+    Result writeTimelines(const juce::Array<juce::File>& files, int numThreads = 0) const
+    {
+        return scan(files, [&files](int index, const MidiTools::ChordTimelineAnalyser& analyser)
+        {
+            const auto target = files.getReference(index).withFileExtension(".chords");
+            juce::FileOutputStream out(target);
+            if (! out.openedOk())
+                return false;
+            out.setPosition(0);
+            out.truncate();
+            return analyser.writeTimeline(out);
+        }, numThreads);
+    }
+
+private:
+    /**
+        A thread's share of the file list, [first, end) packed in one atomic so that the
+        owner can take files from the front while other threads steal from the back.
+    */
+    struct alignas(64) WorkRange
+    {
+        std::atomic<juce::uint64> range { 0 };
+
+        void set(int first, int end) { range = pack(first, end); }
+
+        int takeFirst()
+        {
+            auto current = range.load();
+            for (;;)
+            {
+                const int first = (int)(juce::uint32)current, end = (int)(current >> 32);
+                if (first >= end)
+                    return -1;
+                if (range.compare_exchange_weak(current, pack(first + 1, end)))
+                    return first;
+            }
+        }
+
+        int takeLast()
+        {
+            auto current = range.load();
+            for (;;)
+            {
+                const int first = (int)(juce::uint32)current, end = (int)(current >> 32);
+                if (first >= end)
+                    return -1;
+                if (range.compare_exchange_weak(current, pack(first, end - 1)))
+                    return end - 1;
+            }
+        }
+
+        static juce::uint64 pack(int first, int end)
+        {
+            return (juce::uint64)(juce::uint32)first | ((juce::uint64)(juce::uint32)end << 32);
+        }
+    };
+
+    MidiTools::ChordTimelineAnalyser::Options options;
+};
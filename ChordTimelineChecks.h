@@ -0,0 +1,144 @@
+/*
+  ==============================================================================
+
+    ChordTimelineChecks.h
+    Created: 17 Oct 2026 2:14:48pm
+
+  ==============================================================================
+*/
+
+#pragma once
+
+#include "MidiTools.h"
+#include <JuceHeader.h>
+
+/**
+    Checks the chord timelines MidiTools::ChordTimelineAnalyser builds from small MIDI files
+    with known harmony, in particular around slice boundaries and silences.
+
+    Include this header in a console application and check the result of run():
+        const auto result = ChordTimelineChecks::run();
+        std::cout << (result.wasOk() ? "OK" : result.getErrorMessage().toStdString()) << "\n";
+        return result.wasOk() ? 0 : 1;
+*/
+namespace ChordTimelineChecks
+{
+    /** A note of a test file, in ticks at 480 per quarter note. */
+    struct Note
+    {
+        int note;
+        juce::int64 start, end;
+    };
+
+    /** Returns a type-0 MIDI file playing the notes on channel 1. */
+    static juce::MemoryBlock makeFile(std::initializer_list<Note> notes)
+    {
+        struct Event { juce::int64 tick; juce::uint8 data[3]; };
+        juce::Array<Event> events;
+        juce::int64 endTick = 0;
+        for (const auto& n : notes)
+        {
+            events.add({ n.start, { 0x90, (juce::uint8)n.note, 100 } });
+            events.add({ n.end, { 0x80, (juce::uint8)n.note, 0 } });
+            endTick = juce::jmax(endTick, n.end);
+        }
+
+        // In time order, note-offs first as sequencers write them.
+        std::stable_sort(events.begin(), events.end(), [](const Event& a, const Event& b)
+        {
+            return a.tick != b.tick ? a.tick < b.tick : a.data[0] < b.data[0];
+        });
+
+        MidiTools::MidiFileWriter writer(480);
+        for (const auto& event : events)
+            writer.addEvent(event.tick, event.data, 3);
+
+        juce::MemoryOutputStream out;
+        writer.writeTo(out, endTick);
+        return out.getMemoryBlock();
+    }
+
+    /** Returns the timeline as chord names, e.g. "CM, Am, silence, GM". */
+    static juce::String describe(const MidiTools::ChordTimelineAnalyser& analyser)
+    {
+        juce::StringArray names;
+        for (const auto& entry : analyser.getTimeline())
+            names.add(entry.pitchClasses == 0 ? juce::String("silence") : entry.getMatch().getName());
+        return names.joinIntoString(", ");
+    }
+
+    /** Analyses the notes and fails unless the timeline reads as expected. */
+    static void expectTimeline(const juce::String& name, MidiTools::ChordTimelineAnalyser::Slicing slicing,
+                               std::initializer_list<Note> notes, const juce::String& expected, juce::StringArray& failures)
+    {
+        MidiTools::ChordTimelineAnalyser::Options options;
+        options.slicing = slicing;
+        MidiTools::ChordTimelineAnalyser analyser(options);
+
+        const auto file = makeFile(notes);
+        if (! analyser.analyse(file.getData(), file.getSize()))
+            failures.add(name + ": the file was not read");
+        else if (describe(analyser) != expected)
+            failures.add(name + ": \"" + describe(analyser) + "\" instead of \"" + expected + "\"");
+    }
+
+    /**
+        Notes released on the first tick of a beat belong to the previous beat only.
+        Every timeline ends with the silence after its last note.
+    */
+    static void checkBeatBoundaries(juce::StringArray& failures)
+    {
+        const auto beats = MidiTools::ChordTimelineAnalyser::Slicing::beats;
+
+        expectTimeline("chords changing on the beat", beats,
+                       { { 60, 0, 480 }, { 64, 0, 480 }, { 67, 0, 480 },
+                         { 57, 480, 960 }, { 60, 480, 960 }, { 64, 480, 960 },
+                         { 55, 1440, 1920 }, { 59, 1440, 1920 }, { 62, 1440, 1920 } },
+                       "CM, Am, silence, GM, silence", failures);
+
+        expectTimeline("notes struck again on the beat", beats,
+                       { { 60, 0, 480 }, { 64, 0, 480 }, { 67, 0, 480 },
+                         { 60, 480, 960 }, { 64, 480, 960 }, { 67, 480, 960 } },
+                       "CM, silence", failures);
+
+        expectTimeline("a chord held over beats without events", beats,
+                       { { 60, 0, 960 }, { 64, 0, 960 }, { 67, 0, 960 },
+                         { 55, 1920, 2400 }, { 59, 1920, 2400 }, { 62, 1920, 2400 } },
+                       "CM, silence, GM, silence", failures);
+    }
+
+    /** A silence follows each chord once it is released, even within the onset window. */
+    static void checkOnsetSilences(juce::StringArray& failures)
+    {
+        const auto onsets = MidiTools::ChordTimelineAnalyser::Slicing::onsets;
+
+        expectTimeline("a strummed chord", onsets,
+                       { { 60, 0, 960 }, { 64, 10, 960 }, { 67, 20, 960 },
+                         { 57, 960, 1440 }, { 60, 960, 1440 }, { 64, 960, 1440 } },
+                       "CM, Am, silence", failures);
+
+        expectTimeline("a staccato chord released within the onset window", onsets,
+                       { { 60, 0, 20 }, { 64, 0, 20 }, { 67, 0, 20 },
+                         { 55, 960, 1440 }, { 59, 960, 1440 }, { 62, 960, 1440 } },
+                       "CM, silence, GM, silence", failures);
+
+        expectTimeline("a staccato chord ending the file", onsets,
+                       { { 60, 0, 20 }, { 64, 0, 20 }, { 67, 0, 20 } },
+                       "CM, silence", failures);
+    }
+
+    /**
+        Runs every check.
+        @return juce::Result::ok(), or a failure listing the timelines that differ.
+    */
+    static juce::Result run()
+    {
+        juce::StringArray failures;
+        checkBeatBoundaries(failures);
+        checkOnsetSilences(failures);
+
+        if (failures.isEmpty())
+            return juce::Result::ok();
+        return juce::Result::fail(juce::String(failures.size()) + " failure(s):\n" + failures.joinIntoString("\n"));
+    }
+}
@@ -11,33 +11,373 @@
 #pragma once
 
 #include <JuceHeader.h>
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cmath>
+#include <cstring>
+#include <limits>
 #include <map>
+#include <string_view>
+#include <thread>
+#include <type_traits>
+#include <vector>
 
 namespace MidiTools
 {
+    /** Which note a name means where languages disagree. */
+    enum class NoteNaming
+    {
+        standard, // "B" is B natural (English, French, Italian).
+        german    // "B" is B flat; B natural is "H" either way.
+    };
+
+    /**
+        A note name spelling in lower case and its semitone offset from C. The languages
+        are a mask of Language flags, used to build the compatibility maps.
+    */
+    struct NoteSpelling
+    {
+        enum Language : juce::uint8 { english = 1, french = 2, italian = 4, german = 8 };
+
+        const char* name;
+        int semitone;
+        juce::uint8 languages;
+    };
+
+    /**
+        Every note name known to MidiTools: English (C, C#, Db), French with or without accents
+        and Italian (Do, Ré, Re, Sib), and German (H, Cis, Es, As). The German "B" (B flat)
+        clashes with the English one, so it is only read by findNoteName() with NoteNaming::german.
+    */
+    static constexpr NoteSpelling noteSpellings[] = {
+        { "c", 0, NoteSpelling::english | NoteSpelling::german }, { "c#", 1, NoteSpelling::english }, { "cb", 11, NoteSpelling::english },
+        { "d", 2, NoteSpelling::english | NoteSpelling::german }, { "d#", 3, NoteSpelling::english }, { "db", 1, NoteSpelling::english },
+        { "e", 4, NoteSpelling::english | NoteSpelling::german }, { "e#", 5, NoteSpelling::english }, { "eb", 3, NoteSpelling::english },
+        { "f", 5, NoteSpelling::english | NoteSpelling::german }, { "f#", 6, NoteSpelling::english }, { "fb", 4, NoteSpelling::english },
+        { "g", 7, NoteSpelling::english | NoteSpelling::german }, { "g#", 8, NoteSpelling::english }, { "gb", 6, NoteSpelling::english },
+        { "a", 9, NoteSpelling::english | NoteSpelling::german }, { "a#", 10, NoteSpelling::english }, { "ab", 8, NoteSpelling::english },
+        { "b", 11, NoteSpelling::english }, { "b#", 0, NoteSpelling::english }, { "bb", 10, NoteSpelling::english },
+
+        { "do", 0, NoteSpelling::french | NoteSpelling::italian }, { "do#", 1, NoteSpelling::french | NoteSpelling::italian }, { "dob", 11, NoteSpelling::french | NoteSpelling::italian },
+        { "re", 2, NoteSpelling::french | NoteSpelling::italian }, { "re#", 3, NoteSpelling::french | NoteSpelling::italian }, { "reb", 1, NoteSpelling::french | NoteSpelling::italian },
+        { "r\xc3\xa9", 2, NoteSpelling::french }, { "r\xc3\xa9#", 3, NoteSpelling::french }, { "r\xc3\xa9" "b", 1, NoteSpelling::french },
+        { "mi", 4, NoteSpelling::french | NoteSpelling::italian }, { "mi#", 5, NoteSpelling::french | NoteSpelling::italian }, { "mib", 3, NoteSpelling::french | NoteSpelling::italian },
+        { "fa", 5, NoteSpelling::french | NoteSpelling::italian }, { "fa#", 6, NoteSpelling::french | NoteSpelling::italian }, { "fab", 4, NoteSpelling::french | NoteSpelling::italian },
+        { "sol", 7, NoteSpelling::french | NoteSpelling::italian }, { "sol#", 8, NoteSpelling::french | NoteSpelling::italian }, { "solb", 6, NoteSpelling::french | NoteSpelling::italian },
+        { "la", 9, NoteSpelling::french | NoteSpelling::italian }, { "la#", 10, NoteSpelling::french | NoteSpelling::italian }, { "lab", 8, NoteSpelling::french | NoteSpelling::italian },
+        { "si", 11, NoteSpelling::french | NoteSpelling::italian }, { "si#", 0, NoteSpelling::french | NoteSpelling::italian }, { "sib", 10, NoteSpelling::french | NoteSpelling::italian },
+
+        { "h", 11, NoteSpelling::german },
+        { "cis", 1, NoteSpelling::german }, { "dis", 3, NoteSpelling::german }, { "eis", 5, NoteSpelling::german }, { "fis", 6, NoteSpelling::german },
+        { "gis", 8, NoteSpelling::german }, { "ais", 10, NoteSpelling::german }, { "his", 0, NoteSpelling::german },
+        { "ces", 11, NoteSpelling::german }, { "des", 1, NoteSpelling::german }, { "es", 3, NoteSpelling::german }, { "fes", 4, NoteSpelling::german },
+        { "ges", 6, NoteSpelling::german }, { "as", 8, NoteSpelling::german },
+    };
+    static constexpr int numNoteSpellings = (int)(sizeof(noteSpellings) / sizeof(noteSpellings[0]));
+
+    /**
+        Packs a note name of at most 4 bytes into a key, folding ASCII and Latin-1 capitals
+        (e.g. "É") to lower case. Every spelling fits, so the key is the whole name and a
+        lookup needs one integer compare. Returns 0 for empty or longer names.
+    */
+    static constexpr juce::uint32 packNoteName(std::string_view name)
+    {
+        if (name.empty() || name.size() > 4)
+            return 0;
+
+        juce::uint32 key = 0;
+        juce::uint8 previous = 0;
+        for (size_t i = 0; i < name.size(); ++i)
+        {
+            auto c = (juce::uint8)name[i];
+            if (c >= 'A' && c <= 'Z')
+                c = (juce::uint8)(c + 'a' - 'A');
+            else if (previous == 0xc3 && c >= 0x80 && c <= 0x9e && c != 0x97) // UTF-8 À-Þ, except ×.
+                c = (juce::uint8)(c + 0x20);
+            previous = (juce::uint8)name[i];
+            key |= (juce::uint32)c << (8 * i);
+        }
+        return key;
+    }
+
+    /**
+        A perfect hash of the packed noteSpellings: multiplying by noteNameHashMultiplier and
+        keeping the top bits gives a distinct slot for every spelling. The multiplier was
+        found by search; the static_assert below fails if a new spelling collides.
+    */
+    static constexpr juce::uint32 noteNameHashMultiplier = 0xb5f0a2bdu;
+    static constexpr int noteNameHashBits = 7;
+
+    struct NoteNameSlot
+    {
+        juce::uint32 key = 0;
+        juce::int8 semitone = -1;
+    };
+
+    static constexpr int getNoteNameSlot(juce::uint32 key)
+    {
+        return (int)((key * noteNameHashMultiplier) >> (32 - noteNameHashBits));
+    }
+
+    static constexpr std::array<NoteNameSlot, (1 << noteNameHashBits)> buildNoteNameTable()
+    {
+        std::array<NoteNameSlot, (1 << noteNameHashBits)> table {};
+        for (const auto& spelling : noteSpellings)
+        {
+            const auto key = packNoteName(spelling.name);
+            auto& slot = table[(size_t)getNoteNameSlot(key)];
+            slot.key = key;
+            slot.semitone = (juce::int8)spelling.semitone;
+        }
+        return table;
+    }
+
+    static constexpr auto noteNameTable = buildNoteNameTable();
+
+    static constexpr bool isNoteNameHashPerfect()
+    {
+        int numUsed = 0;
+        for (const auto& slot : noteNameTable)
+            numUsed += slot.key != 0 ? 1 : 0;
+        return numUsed == numNoteSpellings;
+    }
+
+    static_assert(isNoteNameHashPerfect(), "Two note spellings share a slot: search for another noteNameHashMultiplier");
+
+    /**
+        Returns the semitone offset from C (0-11) of a note name without octave, or -1 if it is
+        not known. Case-insensitive, ignores surrounding spaces and never allocates.
+        @param name   UTF-8 text such as "C#", "Bb", "ré", "Sol#" or "Fis".
+        @param naming Pass NoteNaming::german to read "B" as B flat.
+    */
+    static constexpr int findNoteName(std::string_view name, NoteNaming naming = NoteNaming::standard)
+    {
+        while (! name.empty() && (name.front() == ' ' || name.front() == '\t'))
+            name.remove_prefix(1);
+        while (! name.empty() && (name.back() == ' ' || name.back() == '\t'))
+            name.remove_suffix(1);
+
+        const auto key = packNoteName(name);
+        if (key == 0)
+            return -1;
+        if (key == 'b' && naming == NoteNaming::german)
+            return 10;
+
+        const auto& slot = noteNameTable[(size_t)getNoteNameSlot(key)];
+        return slot.key == key ? slot.semitone : -1;
+    }
+
+    static int findNoteName(const juce::String& name, NoteNaming naming = NoteNaming::standard)
+    {
+        return findNoteName(std::string_view(name.toRawUTF8(), name.getNumBytesAsUTF8()), naming);
+    }
+
+    /** Returns the spellings of the given languages as a map, for getNoteNameOffsetMap() and friends. */
+    static std::map<juce::String, int> makeNoteNameOffsetMap(juce::uint8 languages)
+    {
+        std::map<juce::String, int> noteOffsets;
+        for (const auto& spelling : noteSpellings)
+            if ((spelling.languages & languages) != 0)
+                noteOffsets[juce::String::fromUTF8(spelling.name)] = spelling.semitone;
+        return noteOffsets;
+    }
+
     /**
         Returns a map of note names (C, C#, Db, etc.) to their semitone offset from C.
-        This is defined as a static function to ensure it's initialized only once.
+        Kept for compatibility: findNoteName() reads the same names without allocating.
     */
     static const std::map<juce::String, int>& getNoteNameOffsetMap()
     {
-        static const std::map<juce::String, int> noteOffsets = {
-            {"c", 0}, {"b#", 0},
-            {"c#", 1}, {"db", 1},
-            {"d", 2},
-            {"d#", 3}, {"eb", 3},
-            {"e", 4}, {"fb", 4},
-            {"f", 5}, {"e#", 5},
-            {"f#", 6}, {"gb", 6},
-            {"g", 7},
-            {"g#", 8}, {"ab", 8},
-            {"a", 9},
-            {"a#", 10}, {"bb", 10},
-            {"b", 11}, {"cb", 11}
-        };
+        static const std::map<juce::String, int> noteOffsets = makeNoteNameOffsetMap(NoteSpelling::english);
         return noteOffsets;
     }
 
+    /**
+        A small, fast pseudo-random generator (xoshiro128**) with explicit seeding.
+        Give each object that needs randomness its own instance instead of sharing
+        juce::Random::getSystemRandom(): there is no shared state to contend on, and the
+        same seed always produces the same sequence. Not thread-safe; one per thread.
+    */
+    class FastRandom
+    {
+    public:
+        /** Creates a generator with a seed taken from the system random generator. */
+        FastRandom() : FastRandom((juce::uint64)juce::Random::getSystemRandom().nextInt64()) {}
+
+        explicit FastRandom(juce::uint64 seed) { setSeed(seed); }
+
+        /** Resets the generator; two generators with the same seed produce the same numbers. */
+        void setSeed(juce::uint64 seed)
+        {
+            // Expand the seed with splitmix64, which never yields an all-zero state.
+            for (int i = 0; i < 4; i += 2)
+            {
+                seed += 0x9e3779b97f4a7c15ull;
+                juce::uint64 z = seed;
+                z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ull;
+                z = (z ^ (z >> 27)) * 0x94d049bb133111ebull;
+                z ^= z >> 31;
+                state[i] = (juce::uint32)z;
+                state[i + 1] = (juce::uint32)(z >> 32);
+            }
+        }
+
+        /** Returns the next 32 random bits. */
+        juce::uint32 nextUInt32()
+        {
+            const juce::uint32 result = rotateLeft(state[1] * 5, 7) * 9;
+            const juce::uint32 t = state[1] << 9;
+            state[2] ^= state[0];
+            state[3] ^= state[1];
+            state[1] ^= state[2];
+            state[0] ^= state[3];
+            state[2] ^= t;
+            state[3] = rotateLeft(state[3], 11);
+            return result;
+        }
+
+        /** Returns a random integer between 0 and maxValue - 1. maxValue must be positive. */
+        int nextInt(int maxValue)
+        {
+            jassert(maxValue > 0);
+            return (int)(((juce::uint64)nextUInt32() * (juce::uint64)maxValue) >> 32);
+        }
+
+        bool nextBool() { return (nextUInt32() & 0x80000000u) != 0; }
+
+        /** Returns a random float in the range [0, 1). */
+        float nextFloat() { return (float)(nextUInt32() >> 8) * (1.0f / 16777216.0f); }
+
+    private:
+        static juce::uint32 rotateLeft(juce::uint32 x, int k) { return (x << k) | (x >> (32 - k)); }
+
+        juce::uint32 state[4];
+    };
+
+    /**
+        Returns a generator owned by the calling thread, used by the getRandom... helpers
+        when no generator is passed in.
+    */
+    static FastRandom& getThreadRandom()
+    {
+        thread_local FastRandom random;
+        return random;
+    }
+
+    /**
+        A set of pitch classes (0-11) stored as a 12-bit mask, where bit n is set when
+        pitch class n (C=0, C#=1, ...) is present. All operations are constant time.
+    */
+    struct PitchClassSet
+    {
+        static constexpr juce::uint16 fullMask = 0x0fff;
+
+        juce::uint16 mask = 0;
+
+        constexpr PitchClassSet() = default;
+        constexpr explicit PitchClassSet(juce::uint16 bits) : mask((juce::uint16)(bits & fullMask)) {}
+
+        /** Builds a set from MIDI note numbers (or semitones), ignoring the octave. */
+        template <typename Collection>
+        static PitchClassSet fromNotes(const Collection& notes)
+        {
+            PitchClassSet set;
+            for (const auto& note : notes)
+                set = set.with(note);
+            return set;
+        }
+
+        /** Returns a copy with the pitch class of a note added. Negative notes are ignored. */
+        constexpr PitchClassSet with(int note) const
+        {
+            return note < 0 ? *this : PitchClassSet((juce::uint16)(mask | (1u << (note % 12))));
+        }
+
+        /** Returns true if the pitch class of a note is in the set. */
+        constexpr bool contains(int note) const
+        {
+            return note >= 0 && (mask & (1u << (note % 12))) != 0;
+        }
+
+        /** Returns the set transposed up by a number of semitones (a rotation of the 12 bits). */
+        constexpr PitchClassSet transposed(int semitones) const
+        {
+            const int shift = ((semitones % 12) + 12) % 12;
+            return PitchClassSet((juce::uint16)(((unsigned)mask << shift) | ((unsigned)mask >> (12 - shift))));
+        }
+
+        constexpr bool equals(PitchClassSet other) const      { return mask == other.mask; }
+        constexpr bool isSubsetOf(PitchClassSet other) const  { return (mask & ~other.mask) == 0; }
+        constexpr bool isEmpty() const                        { return mask == 0; }
+        int intersectionSize(PitchClassSet other) const       { return juce::countNumberOfBits((juce::uint32)(mask & other.mask)); }
+        int size() const                                      { return juce::countNumberOfBits((juce::uint32)mask); }
+
+        constexpr bool operator==(PitchClassSet other) const  { return equals(other); }
+        constexpr bool operator!=(PitchClassSet other) const  { return ! equals(other); }
+    };
+
+    /**
+        A chord quality: its name suffix and the semitone offsets from the root of each degree,
+        in the same slot order as Chord::getDegrees() (fundamental, 3rd, 5th, 7th, 9th, 11th, 13th).
+        Suspended seconds and fourths live in the 9th and 11th slots, sixths in the 13th slot.
+    */
+    struct ChordQuality
+    {
+        const char* suffix;
+        int degrees[7]; // -1 means absent.
+
+        constexpr PitchClassSet getPitchClassSet() const
+        {
+            juce::uint16 bits = 0;
+            for (int offset : degrees)
+                if (offset >= 0)
+                    bits = (juce::uint16)(bits | (1u << (offset % 12)));
+            return PitchClassSet(bits);
+        }
+    };
+
+    /** The chord qualities known to MidiTools, most common first. Order is used to break ties. */
+    static constexpr ChordQuality chordQualities[] = {
+        { "M",     {  0,  4,  7, -1, -1, -1, -1 } },
+        { "m",     {  0,  3,  7, -1, -1, -1, -1 } },
+        { "7",     {  0,  4,  7, 10, -1, -1, -1 } },
+        { "m7",    {  0,  3,  7, 10, -1, -1, -1 } },
+        { "M7",    {  0,  4,  7, 11, -1, -1, -1 } },
+        { "5",     {  0, -1,  7, -1, -1, -1, -1 } },
+        { "dim",   {  0,  3,  6, -1, -1, -1, -1 } },
+        { "aug",   {  0,  4,  8, -1, -1, -1, -1 } },
+        { "sus4",  {  0, -1,  7, -1, -1,  5, -1 } },
+        { "sus2",  {  0, -1,  7, -1,  2, -1, -1 } },
+        { "m7b5",  {  0,  3,  6, 10, -1, -1, -1 } },
+        { "dim7",  {  0,  3,  6,  9, -1, -1, -1 } },
+        { "mM7",   {  0,  3,  7, 11, -1, -1, -1 } },
+        { "6",     {  0,  4,  7, -1, -1, -1,  9 } },
+        { "m6",    {  0,  3,  7, -1, -1, -1,  9 } },
+        { "7sus4", {  0, -1,  7, 10, -1,  5, -1 } },
+        { "add9",  {  0,  4,  7, -1,  2, -1, -1 } },
+        { "9",     {  0,  4,  7, 10,  2, -1, -1 } },
+        { "m9",    {  0,  3,  7, 10,  2, -1, -1 } },
+        { "M9",    {  0,  4,  7, 11,  2, -1, -1 } },
+        { "11",    {  0,  4,  7, 10,  2,  5, -1 } },
+        { "m11",   {  0,  3,  7, 10,  2,  5, -1 } },
+        { "13",    {  0,  4,  7, 10,  2, -1,  9 } },
+        { "7b5",   {  0,  4,  6, 10, -1, -1, -1 } },
+        { "7#5",   {  0,  4,  8, 10, -1, -1, -1 } },
+        { "7b9",   {  0,  4,  7, 10,  1, -1, -1 } },
+        { "7#9",   {  0,  4,  7, 10,  3, -1, -1 } },
+        { "7#11",  {  0,  4,  7, 10, -1,  6, -1 } },
+        { "7b13",  {  0,  4,  7, 10, -1, -1,  8 } },
+        { "M7#11", {  0,  4,  7, 11, -1,  6, -1 } },
+        { "9sus4", {  0, -1,  7, 10,  2,  5, -1 } },
+        { "M13",   {  0,  4,  7, 11,  2, -1,  9 } },
+        { "m13",   {  0,  3,  7, 10,  2, -1,  9 } },
+        { "69",    {  0,  4,  7, -1,  2, -1,  9 } },
+        { "madd9", {  0,  3,  7, -1,  2, -1, -1 } },
+        { "",      {  0, -1, -1, -1, -1, -1, -1 } }, // Single note
+    };
+    static constexpr int numChordQualities = (int)(sizeof(chordQualities) / sizeof(chordQualities[0]));
+
     /**
         Represents a musical scale, defined by a root note and a type.
         The class stores the 7 notes of the scale as semitone values (0-11).
@@ -89,19 +429,12 @@ namespace MidiTools
 
         /**
             Constructs a scale from a root note name and a scale type.
-            @param rootNoteName The name of the root note (e.g., "C", "F#", "Bb").
+            @param rootNoteName The name of the root note (e.g., "C", "F#", "Bb", "Sol"). C if unknown.
             @param scaleType    The type of scale to generate.
         */
         Scale(const juce::String& rootNoteName, Type scaleType)
         {
-            auto& noteMap = getNoteNameOffsetMap();
-            auto cleanedName = rootNoteName.trim().toLowerCase();
-            int rootSemitone = 0;
-
-            if (noteMap.count(cleanedName))
-                rootSemitone = noteMap.at(cleanedName);
-
-            buildScale(rootSemitone, scaleType);
+            buildScale(juce::jmax(0, findNoteName(rootNoteName)), scaleType);
         }
 
         /**
@@ -170,53 +503,119 @@ namespace MidiTools
             return names;
         }
 
+        /** How makeQuantizeTable() maps notes that are not in the scale. */
+        enum class QuantizeMode
+        {
+            Nearest, // Closest scale note; ties go down.
+            Up,      // Next scale note above.
+            Down     // Next scale note below.
+        };
+
+        /** The intervals of a scale type, in semitones from its root. */
+        struct Intervals
+        {
+            int numNotes;
+            int semitones[8];
+
+            constexpr PitchClassSet getPitchClassSet() const
+            {
+                juce::uint16 bits = 0;
+                for (int i = 0; i < numNotes; ++i)
+                    bits = (juce::uint16)(bits | (1u << semitones[i]));
+                return PitchClassSet(bits);
+            }
+        };
+
+        /** Interval table for every scale type, indexed by Type. */
+        static constexpr Intervals scaleIntervals[] = {
+            { 7, {0, 2, 4, 5, 7, 9, 11} }, // Major (Ionian)
+            { 7, {0, 2, 3, 5, 7, 9, 10} }, // Dorian
+            { 7, {0, 1, 3, 5, 7, 8, 10} }, // Phrygian
+            { 7, {0, 2, 4, 6, 7, 9, 11} }, // Lydian
+            { 7, {0, 2, 4, 5, 7, 9, 10} }, // Mixolydian
+            { 7, {0, 2, 3, 5, 7, 8, 10} }, // Aeolian
+            { 7, {0, 1, 3, 5, 6, 8, 10} }, // Locrian
+            { 7, {0, 2, 3, 5, 7, 9, 11} }, // MelodicMinor
+            { 7, {0, 1, 3, 5, 7, 9, 10} }, // Dorianb9
+            { 7, {0, 2, 4, 6, 8, 9, 11} }, // LydianSharp5
+            { 7, {0, 2, 4, 6, 7, 9, 10} }, // Lydianb7 (Bartok / Lydian Dominant)
+            { 7, {0, 2, 4, 5, 7, 8, 10} }, // Mixolydianb13
+            { 7, {0, 2, 3, 5, 6, 8, 10} }, // LocrianNatural9
+            { 7, {0, 1, 3, 4, 6, 8, 10} }, // Altered
+            { 7, {0, 2, 3, 5, 7, 8, 11} }, // HarmonicMinor
+            { 7, {0, 1, 3, 5, 6, 9, 10} }, // LocrianNatural6
+            { 7, {0, 2, 4, 5, 8, 9, 11} }, // IonianSharp5
+            { 7, {0, 2, 3, 6, 7, 9, 10} }, // DorianSharp4
+            { 7, {0, 1, 4, 5, 7, 8, 10} }, // PhrygianDominant
+            { 7, {0, 3, 4, 6, 7, 9, 11} }, // LydianSharp2
+            { 7, {0, 1, 3, 4, 6, 8, 9} },  // Altered_bb7
+            // Other 7-note scales
+            { 7, {0, 2, 4, 5, 7, 8, 11} }, // HarmonicMajor
+            { 7, {0, 1, 4, 5, 7, 8, 11} }, // DoubleHarmonicMajor
+            { 7, {0, 2, 3, 6, 7, 8, 11} }, // HungarianMinor
+            { 7, {0, 1, 4, 5, 7, 9, 11} }, // NeapolitanMajor
+            { 7, {0, 1, 3, 5, 7, 8, 11} }, // NeapolitanMinor
+            // Non-diatonic scales
+            { 5, {0, 2, 4, 7, 9} },              // MajorPentatonic
+            { 5, {0, 3, 5, 7, 10} },             // MinorPentatonic
+            { 6, {0, 3, 5, 6, 7, 10} },          // Blues
+            { 6, {0, 2, 4, 6, 8, 10} },          // WholeTone
+            { 8, {0, 1, 3, 4, 6, 7, 9, 10} },    // OctatonicHalfWhole
+            { 8, {0, 2, 3, 5, 6, 8, 9, 11} },    // OctatonicWholeHalf
+        };
+        static constexpr int numTypes = (int)(sizeof(scaleIntervals) / sizeof(scaleIntervals[0]));
+
+        /** Returns the intervals of a scale type. */
+        static constexpr const Intervals& getIntervals(Type scaleType)
+        {
+            return scaleIntervals[(int)scaleType];
+        }
+
+        /** Returns the pitch classes of the scale. */
+        PitchClassSet getPitchClassSet() const
+        {
+            return getIntervals(type).getPitchClassSet().transposed(rootNote);
+        }
+
+        /**
+            Builds a table mapping every MIDI note (0-127) to a note of this scale, for real-time
+            quantizing with a single lookup. Notes already in the scale map to themselves.
+            If no scale note exists in the requested direction within 0-127, the other direction is used.
+        */
+        std::array<juce::uint8, 128> makeQuantizeTable(QuantizeMode mode = QuantizeMode::Nearest) const
+        {
+            const auto pitchClasses = getPitchClassSet();
+            std::array<juce::uint8, 128> table {};
+
+            for (int note = 0; note < 128; ++note)
+            {
+                int below = note, above = note;
+                while (below >= 0 && ! pitchClasses.contains(below)) --below;
+                while (above < 128 && ! pitchClasses.contains(above)) ++above;
+
+                int target = note;
+                if (below < 0 && above > 127) target = note; // Empty scale: leave unchanged.
+                else if (below < 0)           target = above;
+                else if (above > 127)         target = below;
+                else if (mode == QuantizeMode::Up)   target = above;
+                else if (mode == QuantizeMode::Down) target = below;
+                else                          target = (above - note < note - below) ? above : below;
+
+                table[(size_t)note] = (juce::uint8)target;
+            }
+            return table;
+        }
+
     private:
         void buildScale(int rootSemitone, Type scaleType)
         {
             this->rootNote = rootSemitone;
             this->type = scaleType;
 
-            static const std::map<Type, juce::Array<int>> scaleIntervals = {
-                {Type::Major,           {0, 2, 4, 5, 7, 9, 11}}, // Ionian
-                {Type::Dorian,          {0, 2, 3, 5, 7, 9, 10}},
-                {Type::Phrygian,        {0, 1, 3, 5, 7, 8, 10}},
-                {Type::Lydian,          {0, 2, 4, 6, 7, 9, 11}},
-                {Type::Mixolydian,      {0, 2, 4, 5, 7, 9, 10}},
-                {Type::Aeolian,         {0, 2, 3, 5, 7, 8, 10}},
-                {Type::Locrian,         {0, 1, 3, 5, 6, 8, 10}},
-                {Type::MelodicMinor,    {0, 2, 3, 5, 7, 9, 11}},
-                {Type::Dorianb9,        {0, 1, 3, 5, 7, 9, 10}},
-                {Type::LydianSharp5,    {0, 2, 4, 6, 8, 9, 11}},
-                {Type::Lydianb7,        {0, 2, 4, 6, 7, 9, 10}}, // Bartok / Lydian Dominant
-                {Type::Mixolydianb13,   {0, 2, 4, 5, 7, 8, 10}},
-                {Type::LocrianNatural9, {0, 2, 3, 5, 6, 8, 10}},
-                {Type::Altered,         {0, 1, 3, 4, 6, 8, 10}},
-                {Type::HarmonicMinor,   {0, 2, 3, 5, 7, 8, 11}},
-                {Type::LocrianNatural6, {0, 1, 3, 5, 6, 9, 10}},
-                {Type::IonianSharp5,    {0, 2, 4, 5, 8, 9, 11}},
-                {Type::DorianSharp4,    {0, 2, 3, 6, 7, 9, 10}},
-                {Type::PhrygianDominant,{0, 1, 4, 5, 7, 8, 10}},
-                {Type::LydianSharp2,    {0, 3, 4, 6, 7, 9, 11}},
-                {Type::Altered_bb7,     {0, 1, 3, 4, 6, 8, 9}},
-                // Other 7-note scales
-                {Type::HarmonicMajor,       {0, 2, 4, 5, 7, 8, 11}},
-                {Type::DoubleHarmonicMajor, {0, 1, 4, 5, 7, 8, 11}},
-                {Type::HungarianMinor,      {0, 2, 3, 6, 7, 8, 11}},
-                {Type::NeapolitanMajor,     {0, 1, 4, 5, 7, 9, 11}},
-                {Type::NeapolitanMinor,     {0, 1, 3, 5, 7, 8, 11}},
-                // Non-diatonic scales
-                {Type::MajorPentatonic,     {0, 2, 4, 7, 9}}, // 5 notes
-                {Type::MinorPentatonic,     {0, 3, 5, 7, 10}}, // 5 notes
-                {Type::Blues,               {0, 3, 5, 6, 7, 10}}, // 6 notes
-                {Type::WholeTone,           {0, 2, 4, 6, 8, 10}}, // 6 notes
-                {Type::OctatonicHalfWhole,  {0, 1, 3, 4, 6, 7, 9, 10}}, // 8 notes
-                {Type::OctatonicWholeHalf,  {0, 2, 3, 5, 6, 8, 9, 11}}, // 8 notes
-            };
-
-            const auto& intervals = scaleIntervals.at(scaleType);
-            for (int interval : intervals)
-                // notes.add((rootSemitone + interval) % 12);
-                notes.add((rootSemitone + interval) % 12);
+            const auto& intervals = getIntervals(scaleType);
+            notes.ensureStorageAllocated(intervals.numNotes);
+            for (int i = 0; i < intervals.numNotes; ++i)
+                notes.add((rootSemitone + intervals.semitones[i]) % 12);
         }
 
         juce::Array<int> notes; // Stores the 7 semitones of the scale (0-11).
@@ -224,159 +623,448 @@ namespace MidiTools
         Type type = Type::Major;
     };
 
+    /** Returns the index of a suffix in chordQualities, or -1 if it is not known. */
+    static int findChordQuality(const char* suffix)
+    {
+        for (int i = 0; i < numChordQualities; ++i)
+            if (std::strcmp(chordQualities[i].suffix, suffix) == 0)
+                return i;
+        return -1;
+    }
+
     /**
-        Represents a musical chord, with properties like its name and the semitones it contains.
+        Other spellings of the chordQualities suffixes, accepted by parseChordSymbol()
+        in addition to the suffixes themselves. French lead sheets mostly use the same
+        suffixes, plus "7M" for a major seventh.
     */
-    class Chord
+    struct ChordSpelling
     {
-    public:
-        /**
-            Constructs a Chord object from a chord name string.
-            The constructor parses the name to determine the root note and chord quality,
-            then populates the set of semitones that define the chord.
-            @param chordName The name of the chord, e.g., "C", "Am", "G7", "F#M7".
-        */
-        Chord(const juce::String& chordName) : name(chordName)
-        {
-            // Initialize all 7 degrees to -1 (absent)
-            // [0] = fundamental, [1] = 3rd, [2] = 5th, [3] = 7th, [4] = 9th, [5] = 11th, [6] = 13th
-            degrees.insertMultiple(0, -1, 7);
+        const char* spelling;
+        const char* suffix;
+    };
 
-            juce::String input = name.trim();
-            if (input.isEmpty())
-                return;
+    static constexpr ChordSpelling chordSpellings[] = {
+        { "maj", "M" }, { "Maj", "M" }, { "major", "M" },
+        { "min", "m" }, { "mi", "m" }, { "-", "m" },
+        { "min7", "m7" }, { "mi7", "m7" }, { "-7", "m7" },
+        { "maj7", "M7" }, { "Maj7", "M7" }, { "ma7", "M7" }, { "7M", "M7" }, { "\xce\x94", "M7" }, { "\xce\x94" "7", "M7" },
+        { "\xc2\xb0", "dim" },
+        { "+", "aug" }, { "+5", "aug" },
+        { "sus", "sus4" },
+        { "sus2", "sus2" },
+        { "-7b5", "m7b5" }, { "min7b5", "m7b5" }, { "m7(b5)", "m7b5" }, { "\xc3\xb8", "m7b5" }, { "\xc3\xb8" "7", "m7b5" },
+        { "\xc2\xb0" "7", "dim7" },
+        { "mmaj7", "mM7" }, { "mMaj7", "mM7" }, { "m(maj7)", "mM7" }, { "m(M7)", "mM7" }, { "minmaj7", "mM7" }, { "-M7", "mM7" }, { "m7M", "mM7" },
+        { "M6", "6" }, { "maj6", "6" },
+        { "-6", "m6" }, { "min6", "m6" },
+        { "7sus", "7sus4" },
+        { "add2", "add9" }, { "(add9)", "add9" },
+        { "-9", "m9" }, { "min9", "m9" },
+        { "maj9", "M9" }, { "\xce\x94" "9", "M9" },
+        { "-11", "m11" }, { "min11", "m11" },
+        { "7(b5)", "7b5" }, { "7-5", "7b5" },
+        { "7(#5)", "7#5" }, { "7+5", "7#5" }, { "aug7", "7#5" }, { "+7", "7#5" },
+        { "7(b9)", "7b9" }, { "7(#9)", "7#9" }, { "7(#11)", "7#11" }, { "7(b13)", "7b13" },
+        { "maj7#11", "M7#11" }, { "\xce\x94" "#11", "M7#11" },
+        { "9sus", "9sus4" },
+        { "maj13", "M13" }, { "\xce\x94" "13", "M13" },
+        { "-13", "m13" }, { "min13", "m13" },
+        { "6/9", "69" }, { "6add9", "69" },
+        { "m(add9)", "madd9" }, { "-add9", "madd9" },
+    };
 
-            juce::String rootNoteStr;
-            auto& noteMap = getNoteNameOffsetMap();
-            int root = -1;
+    /**
+        A chord symbol split into its parts by parseChordSymbol().
+        Offsets are in bytes from the start of the parsed text, so callers can reuse the
+        original spelling of each part.
+    */
+    struct ChordSymbol
+    {
+        int root = -1;         // Semitone of the root (0-11), -1 if the symbol was not recognised.
+        int quality = -1;      // Index into chordQualities.
+        int bass = -1;         // Semitone of the slash bass note, -1 if there is none.
+        int rootStart = 0;     // Start of the root note name.
+        int qualityStart = 0;  // Start of the quality spelling, i.e. the end of the root.
+        int qualityEnd = 0;    // End of the quality spelling, i.e. the '/' of a slash chord.
+
+        bool isValid() const { return root != -1; }
+    };
 
-            // --- 1. Parse the chord string to find the root and quality ---
-            if (input.endsWith("M7"))
-            {
-                rootNoteStr = input.dropLastCharacters(2).toLowerCase();
-                if (noteMap.find(rootNoteStr) == noteMap.end()) return;
-                root = noteMap.at(rootNoteStr);
-                degrees.set(0, root);                  // Root
-                degrees.set(1, (root + 4) % 12);       // Major Third
-                degrees.set(2, (root + 7) % 12);       // Perfect Fifth
-                degrees.set(3, (root + 11) % 12);      // Major Seventh
-            }
-            else if (input.endsWith("m7"))
-            {
-                rootNoteStr = input.dropLastCharacters(2).toLowerCase();
-                if (noteMap.find(rootNoteStr) == noteMap.end()) return;
-                root = noteMap.at(rootNoteStr);
-                degrees.set(0, root);                  // Root
-                degrees.set(1, (root + 3) % 12);       // Minor Third
-                degrees.set(2, (root + 7) % 12);       // Perfect Fifth
-                degrees.set(3, (root + 10) % 12);      // Minor Seventh
-            }
-            else if (input.endsWith("7"))
-            {
-                rootNoteStr = input.dropLastCharacters(1).toLowerCase();
-                if (noteMap.find(rootNoteStr) == noteMap.end()) return;
-                root = noteMap.at(rootNoteStr);
-                degrees.set(0, root);                  // Root
-                degrees.set(1, (root + 4) % 12);       // Major Third
-                degrees.set(2, (root + 7) % 12);       // Perfect Fifth
-                degrees.set(3, (root + 10) % 12);      // Minor Seventh
-            }
-            else if (input.endsWith("5"))
-            {
-                rootNoteStr = input.dropLastCharacters(1).toLowerCase();
-                if (noteMap.find(rootNoteStr) == noteMap.end()) return;
-                root = noteMap.at(rootNoteStr);
-                degrees.set(0, root);                  // Root
-                degrees.set(2, (root + 7) % 12);       // Perfect Fifth
-            }
-            else if (input.endsWith("m"))
-            {
-                rootNoteStr = input.dropLastCharacters(1).toLowerCase();
-                if (noteMap.find(rootNoteStr) == noteMap.end()) return;
-                root = noteMap.at(rootNoteStr);
-                degrees.set(0, root);                  // Root
-                degrees.set(1, (root + 3) % 12);       // Minor Third
-                degrees.set(2, (root + 7) % 12);       // Perfect Fifth
-            }
-            else if (input.endsWith("M"))
-            {
-                rootNoteStr = input.dropLastCharacters(1).toLowerCase();
-                if (noteMap.find(rootNoteStr) == noteMap.end()) return;
-                root = noteMap.at(rootNoteStr);
-                degrees.set(0, root);                  // Root
-                degrees.set(1, (root + 4) % 12);       // Major Third
-                degrees.set(2, (root + 7) % 12);       // Perfect Fifth
-            }
-            else // Assume single note
+    /**
+        A table-driven parser for chord symbols, built once on first use.
+        Two tries share one transition table over the bytes used by the known spellings:
+        one for root names (English and French, with #, b, U+266F or U+266D, case-insensitive),
+        one for quality spellings (case-sensitive, since "M" and "m" differ). Parsing walks them
+        byte by byte and only backtracks over the few accepting states found on the way, e.g.
+        "Faug" first tries the French root "Fa", then "F" + "aug".
+    */
+    class ChordSymbolParser
+    {
+    public:
+        static const ChordSymbolParser& getInstance()
+        {
+            static const ChordSymbolParser parser;
+            return parser;
+        }
+
+        /** Parses a chord symbol such as "Am7", "F#m7b5", "Bbmaj7/D" or "Ré m". Never allocates. */
+        ChordSymbol parse(std::string_view text) const noexcept
+        {
+            ChordSymbol result;
+            int begin = 0, end = (int)text.size();
+            while (begin < end && isSpace(text[(size_t)begin]))
+                ++begin;
+            while (end > begin && isSpace(text[(size_t)end - 1]))
+                --end;
+
+            Match roots[maxSpellingLength + 1];
+            const int numRoots = walk(rootTrie, text, begin, end, true, roots);
+
+            // Longest root first, then longest quality, then an optional "/bass" that must end the symbol.
+            for (int r = numRoots; --r >= 0;)
             {
-                rootNoteStr = input.toLowerCase();
-                if (noteMap.find(rootNoteStr) == noteMap.end()) return;
-                root = noteMap.at(rootNoteStr);
-                degrees.set(0, root); // Only the root note
+                int qualityStart = roots[r].end;
+                while (qualityStart < end && isSpace(text[(size_t)qualityStart]))
+                    ++qualityStart;
+
+                Match qualities[maxSpellingLength + 1];
+                for (int q = walk(qualityTrie, text, qualityStart, end, false, qualities); --q >= 0;)
+                {
+                    const int qualityEnd = qualities[q].end;
+                    int bass = -1;
+                    if (qualityEnd < end)
+                    {
+                        if (text[(size_t)qualityEnd] != '/')
+                            continue;
+                        Match basses[maxSpellingLength + 1];
+                        const int numBasses = walk(rootTrie, text, qualityEnd + 1, end, true, basses);
+                        if (numBasses == 0 || basses[numBasses - 1].end != end)
+                            continue;
+                        bass = basses[numBasses - 1].value;
+                    }
+
+                    result.root = roots[r].value;
+                    result.quality = qualities[q].value;
+                    result.bass = bass;
+                    result.rootStart = begin;
+                    result.qualityStart = qualityStart;
+                    result.qualityEnd = qualityEnd;
+                    return result;
+                }
             }
+            return result;
         }
 
-        /** Returns an ordered array of 7 semitones representing the chord's degrees.
-            The order is: fundamental, 3rd, 5th, 7th, 9th, 11th, 13th.
-            An absent degree is represented by -1.
-        */
-        const juce::Array<int>& getDegrees() const { return degrees; }
+    private:
+        static constexpr int maxNodes = 512;
+        static constexpr int maxSymbols = 64;
+        static constexpr int maxSpellingLength = 12;
 
-        /** Returns the original name of the chord. */
-        const juce::String& getName() const { return name; }
+        struct Node
+        {
+            juce::int16 next[maxSymbols];
+            juce::int8 value; // Root semitone or quality index if a spelling ends here, otherwise -1.
+        };
 
-        /** Gets the semitone value of a specific degree of the chord.
-         *  This is primarily for named chords (e.g. "CM7") where degrees have musical meaning.
-         *  For chords set by raw notes, this will reflect the semitone of the Nth note in the sorted array.
-         *
-            @param degreeIndex The index of the degree (0=fundamental, 1=third, etc.).
-            @return The semitone value (0-11), or -1 if the degree is absent or the index is invalid.
-        */
-        int getDegree(int degreeIndex) const
+        struct Match
         {
-            if (juce::isPositiveAndBelow(degreeIndex, degrees.size()))
-                return degrees[degreeIndex];
-            return -1;
-        }
+            int end;
+            int value;
+        };
 
-        /**
-            Sets the chord's degrees directly from an array of semitones.
-            This is for the "Notes Played" mode. It converts MIDI notes to unique, octave-less
-            semitones and assigns them to the first available degree slots.
-            The degrees are assigned in the order they appear in the input array.
-            @param notes An array of MIDI note numbers.
-        */
-        void setDegreesByArray(const juce::Array<int>& notes)
+        ChordSymbolParser()
         {
-            name = "Custom";
-            degrees.clear();
-            degrees.insertMultiple(0, -1, 7); // Reset to 7 absent degrees
+            rootTrie = addNode();
+            qualityTrie = addNode();
 
-            if (notes.isEmpty())
-                return;
+            static const struct { const char* name; int semitone; } noteNames[] = {
+                { "c", 0 }, { "d", 2 }, { "e", 4 }, { "f", 5 }, { "g", 7 }, { "a", 9 }, { "b", 11 },
+                { "do", 0 }, { "re", 2 }, { "r\xc3\xa9", 2 }, { "r\xc3\x89", 2 }, { "mi", 4 },
+                { "fa", 5 }, { "sol", 7 }, { "la", 9 }, { "si", 11 }
+            };
+            static const struct { const char* text; int shift; } accidentals[] = {
+                { "", 0 }, { "#", 1 }, { "b", -1 }, { "\xe2\x99\xaf", 1 }, { "\xe2\x99\xad", -1 }
+            };
+            for (const auto& note : noteNames)
+                for (const auto& accidental : accidentals)
+                    setValue(insert(insert(rootTrie, note.name), accidental.text), (note.semitone + accidental.shift + 12) % 12);
+
+            for (int quality = 0; quality < numChordQualities; ++quality)
+                setValue(insert(qualityTrie, chordQualities[quality].suffix), quality);
+            for (const auto& spelling : chordSpellings)
+                setValue(insert(qualityTrie, spelling.spelling), findChordQuality(spelling.suffix));
+        }
 
-            juce::Array<int> sortedNotes = notes;
-            sortedNotes.sort();
+        static bool isSpace(char c) { return c == ' ' || c == '\t'; }
 
-            int lowestNote = sortedNotes.getFirst() % 12;
+        int addNode()
+        {
+            jassert(numNodes < maxNodes);
+            auto& node = nodes[(size_t)numNodes];
+            std::fill(std::begin(node.next), std::end(node.next), (juce::int16)-1);
+            node.value = -1;
+            return numNodes++;
+        }
 
-            juce::SortedSet<int> relativeSemitones;
-            for (int note : sortedNotes)
+        /** Adds the path for text below a node and returns the node it ends on. */
+        int insert(int node, const char* text)
+        {
+            for (; *text != 0; ++text)
             {
-                if (lowestNote > note % 12)
-                    relativeSemitones.add(note % 12 + 12);
-                else
-                    relativeSemitones.add(note % 12);
+                auto& symbol = symbols[(juce::uint8)*text];
+                if (symbol == 0)
+                {
+                    jassert(numSymbols < maxSymbols);
+                    symbol = (juce::uint8)numSymbols++;
+                }
+                if (nodes[(size_t)node].next[symbol] < 0)
+                {
+                    const int child = addNode();
+                    nodes[(size_t)node].next[symbol] = (juce::int16)child;
+                }
+                node = nodes[(size_t)node].next[symbol];
             }
+            return node;
+        }
 
-            for (int i = 0; i < juce::jmin(7, relativeSemitones.size()); ++i)
-                degrees.set(i, relativeSemitones.getUnchecked(i));
+        void setValue(int node, int value)
+        {
+            // Each spelling must have exactly one meaning.
+            jassert(value >= 0 && (nodes[(size_t)node].value < 0 || nodes[(size_t)node].value == value));
+            nodes[(size_t)node].value = (juce::int8)value;
         }
 
-        /**
-            Sets the chord directly from an array of raw MIDI note numbers.
-            This is for the "Chord Played As Is" mode. It stores the exact notes,
-            preserving octave and allowing for complex, non-standard chords.
+        /** Follows text from a trie root, recording every position where a spelling ends. */
+        int walk(int node, std::string_view text, int pos, int end, bool ignoreCase, Match* matches) const noexcept
+        {
+            int numMatches = 0;
+            if (nodes[(size_t)node].value >= 0)
+                matches[numMatches++] = { pos, nodes[(size_t)node].value };
+
+            for (; pos < end; ++pos)
+            {
+                auto c = (juce::uint8)text[(size_t)pos];
+                if (ignoreCase && c >= 'A' && c <= 'Z')
+                    c = (juce::uint8)(c + 'a' - 'A');
+                const int symbol = symbols[c];
+                node = symbol != 0 ? nodes[(size_t)node].next[symbol] : -1;
+                if (node < 0)
+                    break;
+                if (nodes[(size_t)node].value >= 0)
+                    matches[numMatches++] = { pos + 1, nodes[(size_t)node].value };
+            }
+            return numMatches;
+        }
+
+        std::array<Node, maxNodes> nodes;
+        std::array<juce::uint8, 256> symbols {}; // Symbol of each byte, 0 if no spelling uses it.
+        int numNodes = 0;
+        int numSymbols = 1;
+        int rootTrie = 0, qualityTrie = 0;
+    };
+
+    /**
+        Splits a chord symbol into root, quality and slash bass without allocating.
+        Roots may be English (C, F#, Bb) or French (Do, Ré, Sib), with #, b, U+266F or U+266D.
+        Qualities are the chordQualities suffixes or one of chordSpellings, e.g. "Cmaj7",
+        "C-7", "Cø", "C°7", "C7(b9)", "Do7M" or "C6/9"; no suffix means a single note.
+        Where a French root and an English root followed by a quality both fit, the French root wins.
+        @param symbol UTF-8 text, e.g. "Am7", "Bbmaj7/D" or "Sol7".
+        @return The parts of the symbol; check ChordSymbol::isValid().
+    */
+    static ChordSymbol parseChordSymbol(std::string_view symbol) noexcept
+    {
+        return ChordSymbolParser::getInstance().parse(symbol);
+    }
+
+    static ChordSymbol parseChordSymbol(const juce::String& symbol)
+    {
+        return parseChordSymbol(std::string_view(symbol.toRawUTF8(), symbol.getNumBytesAsUTF8()));
+    }
+
+    /**
+        A fixed-size, trivially copyable snapshot of a Chord, for the audio thread.
+        Degrees and raw notes are stored inline and the name is replaced by a kind and a
+        quality index, so copying one never allocates and it can be passed through atomics
+        or lock-free queues. Build it with Chord::getValue().
+    */
+    struct ChordValue
+    {
+        enum class Kind : juce::uint8
+        {
+            Empty,    // Unparseable name: no degrees present.
+            Named,    // Parsed from a name: root and quality are set.
+            Diatonic, // Built by Chord::fromScaleAndDegree().
+            Custom    // Set from played notes.
+        };
+
+        static constexpr int maxDegrees = 8;   // 7 chord degrees, or the 8 notes of an octatonic scale.
+        static constexpr int maxRawNotes = 16;
+
+        Kind kind = Kind::Empty;
+        juce::int8 root = -1;    // Semitone of the fundamental, -1 if absent.
+        juce::int8 quality = -1; // Index into chordQualities for Named chords.
+        juce::int8 bass = -1;    // Semitone of the slash bass note of Named chords, -1 if absent.
+        juce::uint8 numDegrees = 7;
+        juce::int8 degrees[maxDegrees] = { -1, -1, -1, -1, -1, -1, -1, -1 }; // -1 means absent.
+        juce::uint8 numRawNotes = 0;
+        juce::int16 rawNotes[maxRawNotes] = {}; // Sorted MIDI notes for "as is" mode.
+        juce::uint32 degreeMask = 0;            // Bit n set when a degree has the value n.
+        PitchClassSet pitchClasses;
+
+        bool isCustom() const { return kind == Kind::Custom; }
+        int getNumDegrees() const { return numDegrees; }
+        int getNumRawNotes() const { return numRawNotes; }
+
+        /** Same as Chord::getDegree(). */
+        int getDegree(int degreeIndex) const
+        {
+            return juce::isPositiveAndBelow(degreeIndex, (int)numDegrees) ? degrees[degreeIndex] : -1;
+        }
+
+        int getRawNote(int index) const
+        {
+            return juce::isPositiveAndBelow(index, (int)numRawNotes) ? rawNotes[index] : -1;
+        }
+
+        PitchClassSet getPitchClassSet() const { return pitchClasses; }
+
+        /** Same as Chord::getNumDistinctDegrees(). */
+        int getNumDistinctDegrees() const { return juce::countNumberOfBits(degreeMask); }
+
+        /** Same as Chord::getSortedDegree(). */
+        int getSortedDegree(int index) const
+        {
+            if (index < 0)
+                return -1;
+            for (int semitone = 0; semitone < 32; ++semitone)
+                if ((degreeMask & (1u << semitone)) != 0 && index-- == 0)
+                    return semitone;
+            return -1;
+        }
+
+        /** Returns a display name, e.g. "Am7" or "Custom". This allocates; keep it off the audio thread. */
+        juce::String getName() const
+        {
+            static const juce::String noteNames[] = { "C", "C#", "D", "D#", "E", "F", "F#", "G", "G#", "A", "A#", "B" };
+            switch (kind)
+            {
+                case Kind::Named:    return noteNames[root % 12] + (quality >= 0 ? chordQualities[quality].suffix : "")
+                                          + (bass >= 0 ? "/" + noteNames[bass % 12] : juce::String());
+                case Kind::Diatonic: return "Diatonic";
+                case Kind::Custom:   return "Custom";
+                case Kind::Empty:    break;
+            }
+            return {};
+        }
+    };
+
+    static_assert(std::is_trivially_copyable<ChordValue>::value, "ChordValue must stay trivially copyable");
+
+    /**
+        Represents a musical chord, with properties like its name and the semitones it contains.
+    */
+    class Chord
+    {
+    public:
+        /**
+            Constructs a Chord object from a chord name string.
+            The constructor parses the name with parseChordSymbol() to determine the root note,
+            quality and slash bass, then populates the set of semitones that define the chord.
+            @param chordName The name of the chord, e.g., "C", "Am", "G7", "F#M7", "Bbmaj7/D", "Sol7".
+        */
+        Chord(const juce::String& chordName) : name(chordName)
+        {
+            // Initialize all 7 degrees to -1 (absent)
+            // [0] = fundamental, [1] = 3rd, [2] = 5th, [3] = 7th, [4] = 9th, [5] = 11th, [6] = 13th
+            degrees.insertMultiple(0, -1, 7);
+
+            const auto symbol = parseChordSymbol(name);
+            if (! symbol.isValid())
+                return;
+
+            quality = symbol.quality;
+            bass = symbol.bass;
+            for (int slot = 0; slot < 7; ++slot)
+            {
+                const int offset = chordQualities[quality].degrees[slot];
+                if (offset >= 0)
+                    degrees.set(slot, (symbol.root + offset) % 12);
+            }
+
+            updateMasks();
+        }
+
+        /** Returns an ordered array of 7 semitones representing the chord's degrees.
+            The order is: fundamental, 3rd, 5th, 7th, 9th, 11th, 13th.
+            An absent degree is represented by -1.
+        */
+        const juce::Array<int>& getDegrees() const { return degrees; }
+
+        /** Returns the original name of the chord. */
+        const juce::String& getName() const { return name; }
+
+        /** Returns the semitone (0-11) of the slash bass note, e.g. 4 for "C/E", or -1 if there is none. */
+        int getBassNote() const { return bass; }
+
+        /** Gets the semitone value of a specific degree of the chord.
+         *  This is primarily for named chords (e.g. "CM7") where degrees have musical meaning.
+         *  For chords set by raw notes, this will reflect the semitone of the Nth note in the sorted array.
+         *
+            @param degreeIndex The index of the degree (0=fundamental, 1=third, etc.).
+            @return The semitone value (0-11), or -1 if the degree is absent or the index is invalid.
+        */
+        int getDegree(int degreeIndex) const
+        {
+            if (juce::isPositiveAndBelow(degreeIndex, degrees.size()))
+                return degrees[degreeIndex];
+            return -1;
+        }
+
+        /**
+            Sets the chord's degrees directly from an array of semitones.
+            This is for the "Notes Played" mode. It converts MIDI notes to unique, octave-less
+            semitones and assigns them to the first available degree slots.
+            The degrees are assigned in the order they appear in the input array.
+            @param notes An array of MIDI note numbers.
+        */
+        void setDegreesByArray(const juce::Array<int>& notes)
+        {
+            name = "Custom";
+            bass = -1;
+            degrees.clear();
+            degrees.insertMultiple(0, -1, 7); // Reset to 7 absent degrees
+
+            if (notes.isEmpty())
+            {
+                updateMasks();
+                return;
+            }
+
+            juce::Array<int> sortedNotes = notes;
+            sortedNotes.sort();
+
+            int lowestNote = sortedNotes.getFirst() % 12;
+
+            juce::SortedSet<int> relativeSemitones;
+            for (int note : sortedNotes)
+            {
+                if (lowestNote > note % 12)
+                    relativeSemitones.add(note % 12 + 12);
+                else
+                    relativeSemitones.add(note % 12);
+            }
+
+            for (int i = 0; i < juce::jmin(7, relativeSemitones.size()); ++i)
+                degrees.set(i, relativeSemitones.getUnchecked(i));
+
+            updateMasks();
+        }
+
+        /**
+            Sets the chord directly from an array of raw MIDI note numbers.
+            This is for the "Chord Played As Is" mode. It stores the exact notes,
+            preserving octave and allowing for complex, non-standard chords.
             @param notes An array of MIDI note numbers.
         */
         void setNotesByArray(const juce::Array<int>& notes)
@@ -446,6 +1134,7 @@ namespace MidiTools
                     newChord.degrees.add(voicedNote);
                 }
             }
+            newChord.updateMasks();
             return newChord;
         }
 
@@ -464,213 +1153,873 @@ namespace MidiTools
             return presentSemitones;
         }
 
+        /** Returns the pitch classes of the present degrees, ignoring voicing. */
+        PitchClassSet getPitchClassSet() const { return pitchClasses; }
+
+        /**
+            Returns this chord as a ChordValue, for passing to the audio thread.
+            At most ChordValue::maxDegrees degrees and the lowest ChordValue::maxRawNotes raw notes are kept.
+        */
+        ChordValue getValue() const
+        {
+            ChordValue value;
+            if (name == "Custom")               value.kind = ChordValue::Kind::Custom;
+            else if (name == "Diatonic")        value.kind = ChordValue::Kind::Diatonic;
+            else if (getDegree(0) != -1)        value.kind = ChordValue::Kind::Named;
+
+            value.root = (juce::int8)getDegree(0);
+            value.quality = (juce::int8)quality;
+            value.bass = (juce::int8)bass;
+            value.numDegrees = (juce::uint8)juce::jmin((int)ChordValue::maxDegrees, degrees.size());
+            for (int i = 0; i < value.numDegrees; ++i)
+                value.degrees[i] = (juce::int8)degrees.getUnchecked(i);
+            value.numRawNotes = (juce::uint8)juce::jmin((int)ChordValue::maxRawNotes, rawNotes.size());
+            for (int i = 0; i < value.numRawNotes; ++i)
+                value.rawNotes[i] = (juce::int16)rawNotes.getUnchecked(i);
+            value.degreeMask = degreeMask;
+            value.pitchClasses = pitchClasses;
+            return value;
+        }
+
+        /** Returns the number of distinct present degree values, i.e. getSortedSet().size(). */
+        int getNumDistinctDegrees() const { return juce::countNumberOfBits(degreeMask); }
+
+        /** Returns the index-th smallest distinct present degree value, i.e. getSortedSet()[index],
+            without building the set. Returns -1 if the index is out of range.
+        */
+        int getSortedDegree(int index) const
+        {
+            if (index < 0)
+                return -1;
+            for (int semitone = 0; semitone < 32; ++semitone)
+                if ((degreeMask & (1u << semitone)) != 0 && index-- == 0)
+                    return semitone;
+            return -1;
+        }
+
     private:
+        /** Recomputes the degree and pitch-class masks after the degrees have changed. */
+        void updateMasks()
+        {
+            degreeMask = 0;
+            for (int degree : degrees)
+            {
+                // Degrees are voiced within two octaves above C (0-23).
+                jassert(degree < 32);
+                if (juce::isPositiveAndBelow(degree, 32))
+                    degreeMask |= 1u << degree;
+            }
+            pitchClasses = PitchClassSet((juce::uint16)((degreeMask | (degreeMask >> 12) | (degreeMask >> 24)) & PitchClassSet::fullMask));
+            if (bass >= 0)
+                pitchClasses = pitchClasses.with(bass);
+        }
+
         juce::String name;
         juce::Array<int> degrees; // Stores 7 degrees: 1, 3, 5, 7, 9, 11, 13. -1 means absent.
         juce::Array<int> rawNotes; // Stores raw MIDI notes for "as is" mode.
+        juce::uint32 degreeMask = 0; // Bit n set when a degree has the value n.
+        PitchClassSet pitchClasses;  // The present degrees folded to pitch classes.
+        int quality = -1;            // Index into chordQualities for chords parsed from a name.
+        int bass = -1;               // Slash bass semitone for chords parsed from a name, -1 if absent.
     };
 
     /**
-        Returns a map of French note names (Do, Ré b, etc.) to their semitone offset from C.
+        Returns the scale degree (0-based index into Scale::getNotes()) of a note, or of the
+        closest scale note below it when the note is not in the scale.
     */
-    static const std::map<juce::String, int>& getFrenchNoteNameOffsetMap()
+    static int getScaleDegree(int scaleRoot, Scale::Type scaleType, int noteNumber)
     {
-        static const std::map<juce::String, int> noteOffsets = {
-            {"do", 0},
-            {"do#", 1}, {"reb", 1},
-            {"re", 2}, {"ré", 2},
-            {"re#", 3}, {"ré#", 3}, {"mib", 3},
-            {"mi", 4},
-            {"fa", 5},
-            {"fa#", 6}, {"solb", 6},
-            {"sol", 7},
-            {"sol#", 8}, {"lab", 8},
-            {"la", 9},
-            {"la#", 10}, {"sib", 10},
-            {"si", 11}
-        };
-        return noteOffsets;
+        const auto& intervals = Scale::getIntervals(scaleType);
+        const int interval = ((noteNumber - scaleRoot) % 12 + 12) % 12;
+        int degree = 0;
+        while (degree + 1 < intervals.numNotes && intervals.semitones[degree + 1] <= interval)
+            ++degree;
+        return degree;
     }
 
-
     /**
-        Converts a MIDI note number into its string representation (e.g., 60 -> "C4").
-        @param noteNumber The MIDI note number (0-127).
-        @return A string representing the note name and octave.
+        Returns Chord::fromScaleAndDegree(Scale(scaleRoot, scaleType), degree, chordMode).getValue()
+        without building the Scale or the Chord, so it never allocates and can be called from
+        the audio thread.
     */
-    static juce::String getNoteName(int noteNumber)
+    static ChordValue getDiatonicChordValue(int scaleRoot, Scale::Type scaleType, int degree, bool chordMode = false)
     {
-        if (noteNumber < 0 || noteNumber > 127)
-            return "Invalid";
+        const auto& intervals = Scale::getIntervals(scaleType);
+        const int scaleSize = intervals.numNotes;
+        degree = (degree % scaleSize + scaleSize) % scaleSize;
 
-        static const juce::String noteNames[] = { "C", "C#", "D", "D#", "E", "F", "F#", "G", "G#", "A", "A#", "B" };
+        auto getScaleNote = [&](int index) { return ((scaleRoot % 12 + 12) % 12 + intervals.semitones[index % scaleSize]) % 12; };
+        const int fundamental = getScaleNote(degree);
+        // Notes below the fundamental are voiced an octave up, as in fromScaleAndDegree().
+        auto getVoicedNote = [&](int interval) { const int note = getScaleNote(degree + interval); return note < fundamental ? note + 12 : note; };
 
-        const int octave = (noteNumber / 12) - 1;
-        const juce::String& note = noteNames[noteNumber % 12];
+        ChordValue value;
+        value.kind = ChordValue::Kind::Diatonic;
+        value.root = (juce::int8)fundamental;
+        value.degrees[0] = (juce::int8)fundamental;
 
-        return note + juce::String(octave);
+        if (chordMode && scaleSize == 7)
+        {
+            static constexpr int stackedThirds[] = { 0, 2, 4, 6, 1, 3, 5 };
+            for (int slot = 1; slot < 7; ++slot)
+                value.degrees[slot] = (juce::int8)getVoicedNote(stackedThirds[slot]);
+        }
+        else
+        {
+            value.numDegrees = (juce::uint8)scaleSize;
+            for (int i = 1; i < scaleSize; ++i)
+                value.degrees[i] = (juce::int8)getVoicedNote(i);
+        }
+
+        for (int i = 0; i < value.numDegrees; ++i)
+            if (value.degrees[i] >= 0)
+                value.degreeMask |= 1u << value.degrees[i];
+        value.pitchClasses = PitchClassSet((juce::uint16)((value.degreeMask | (value.degreeMask >> 12)) & PitchClassSet::fullMask));
+        return value;
     }
 
     /**
-        Converts a note name string (e.g., "C#4") into a MIDI note number.
-        Handles sharps (#), flats (b), and octave numbers. Case-insensitive.
-        @param noteNameWithOctave The note string, e.g., "C4", "Db-1", "f#5".
-        @return The MIDI note number (0-127), or -1 if the string is invalid.
+        The notes held on a keyboard, for the "Notes played" and "Chord played as is" modes.
+        Instead of rebuilding a juce::Array of held notes and calling Chord::setDegreesByArray()
+        or setNotesByArray() on every event, feed note events to noteOn() and noteOff(): the
+        notes are kept in a 128-bit mask plus a linked ring in insertion order, and the
+        pitch-class set and ChordValue are updated in place, without sorting or allocating.
+        getChordValue() holds both the degrees of setDegreesByArray() and the sorted raw
+        notes of setNotesByArray(), ready for Arpeggiator::setChord().
     */
-    static int getNoteNumber(const juce::String& noteNameWithOctave)
+    class HeldNotes
     {
-        juce::String input = noteNameWithOctave.trim().toLowerCase();
-        if (input.isEmpty())
-            return -1;
+    public:
+        HeldNotes() { clear(); }
 
-        juce::String notePart;
-        int octavePartStartIndex = 1;
+        /** Adds a note (0-127). Returns false if it was already held or is out of range. */
+        bool noteOn(int note)
+        {
+            if (! juce::isPositiveAndBelow(note, numNotes) || isHeld(note))
+                return false;
+
+            occupancy[note >> 6] |= (juce::uint64)1 << (note & 63);
+            previous[note] = previous[ringHead];
+            next[note] = (juce::uint8)ringHead;
+            next[previous[ringHead]] = (juce::uint8)note;
+            previous[ringHead] = (juce::uint8)note;
+
+            if (pitchClassCounts[note % 12]++ == 0)
+                pitchClasses = pitchClasses.with(note);
+            ++numHeld;
+            updateChordValue();
+            return true;
+        }
 
-        if (input.length() > 1 && (input[1] == '#' || input[1] == 'b'))
+        /** Removes a note. Returns false if it was not held. */
+        bool noteOff(int note)
         {
-            notePart = input.substring(0, 2);
-            octavePartStartIndex = 2;
+            if (! isHeld(note))
+                return false;
+
+            occupancy[note >> 6] &= ~((juce::uint64)1 << (note & 63));
+            next[previous[note]] = next[note];
+            previous[next[note]] = previous[note];
+
+            if (--pitchClassCounts[note % 12] == 0)
+                pitchClasses = PitchClassSet((juce::uint16)(pitchClasses.mask & ~(1u << (note % 12))));
+            --numHeld;
+            updateChordValue();
+            return true;
         }
-        else
+
+        /** Releases every note. */
+        void clear()
         {
-            notePart = input.substring(0, 1);
+            occupancy[0] = occupancy[1] = 0;
+            previous[ringHead] = next[ringHead] = (juce::uint8)ringHead;
+            std::fill(std::begin(pitchClassCounts), std::end(pitchClassCounts), (juce::uint8)0);
+            pitchClasses = {};
+            numHeld = 0;
+            updateChordValue();
         }
 
-        auto& noteMap = getNoteNameOffsetMap();
-        if (noteMap.find(notePart) == noteMap.end())
-            return -1; // Note name not found
+        bool isHeld(int note) const
+        {
+            return juce::isPositiveAndBelow(note, numNotes) && (occupancy[note >> 6] & ((juce::uint64)1 << (note & 63))) != 0;
+        }
 
-        int noteOffset = noteMap.at(notePart);
+        int size() const { return numHeld; }
+        bool isEmpty() const { return numHeld == 0; }
 
-        juce::String octaveString = input.substring(octavePartStartIndex);
-        if (octaveString.isEmpty() || !octaveString.containsOnly("-0123456789"))
-            return -1; // Invalid or missing octave
+        /** Returns the index-th lowest held note, or -1 if the index is out of range. */
+        int getSortedNote(int index) const
+        {
+            if (! juce::isPositiveAndBelow(index, numHeld))
+                return -1;
+            for (int word = 0; word < 2; ++word)
+            {
+                auto bits = occupancy[word];
+                const int count = juce::countNumberOfBits(bits);
+                if (index < count)
+                {
+                    while (index-- > 0)
+                        bits &= bits - 1;
+                    return word * 64 + getLowestBit(bits);
+                }
+                index -= count;
+            }
+            return -1;
+        }
 
-        int octave = octaveString.getIntValue();
+        int getLowestNote() const { return getSortedNote(0); }
+        int getHighestNote() const { return getSortedNote(numHeld - 1); }
 
-        int midiNote = (octave + 1) * 12 + noteOffset;
+        /** Returns the held note pressed first, or -1 if none is held. */
+        int getOldestNote() const { return numHeld > 0 ? next[ringHead] : -1; }
 
-        if (midiNote >= 0 && midiNote <= 127)
-            return midiNote;
+        /** Returns the held note pressed last, or -1 if none is held. */
+        int getNewestNote() const { return numHeld > 0 ? previous[ringHead] : -1; }
 
-        return -1; // Result is out of MIDI range
-    }
+        /** Calls callback(note) for every held note, from the oldest to the newest. */
+        template <typename Callback>
+        void forEachInInsertionOrder(Callback&& callback) const
+        {
+            for (int note = next[ringHead]; note != ringHead; note = next[note])
+                callback(note);
+        }
 
-    /**
-        Checks if a MIDI note number corresponds to a note name, ignoring the octave.
-        @param noteNumber The MIDI note number to check.
-        @param noteName   The note name to compare against (e.g., "C", "Db", "F#"). Case-insensitive.
-        @return True if the note number's pitch class matches the note name, false otherwise.
-    */
-    static bool isNoteEqual(int noteNumber, const juce::String& noteName)
-    {
-        if (noteNumber < 0 || noteNumber > 127)
-            return false;
+        /** Returns the pitch classes of every held note. */
+        PitchClassSet getPitchClassSet() const { return pitchClasses; }
 
-        juce::String cleanedNoteName = noteName.trim().toLowerCase();
-        if (cleanedNoteName.isEmpty())
-            return false;
+        /**
+            Returns the held notes as a custom chord: the degrees are those of
+            Chord::setDegreesByArray() and the raw notes those of setNotesByArray()
+            (the lowest ChordValue::maxRawNotes), as returned by Chord::getValue().
+        */
+        const ChordValue& getChordValue() const { return value; }
+
+    private:
+        static constexpr int numNotes = 128;
+        static constexpr int ringHead = numNotes; // Sentinel of the insertion-order ring.
 
-        const int noteNumberSemitone = noteNumber % 12;
+        static int getLowestBit(juce::uint64 bits)
+        {
+            return juce::countNumberOfBits((bits & (~bits + 1)) - 1);
+        }
 
-        auto& noteMap = getNoteNameOffsetMap();
-        if (noteMap.find(cleanedNoteName) == noteMap.end())
-            return false; // The provided note name is not valid
+        /** Rebuilds the ChordValue from the masks: at most 12 pitch classes and 16 raw notes. */
+        void updateChordValue()
+        {
+            value = ChordValue();
+            value.kind = ChordValue::Kind::Custom;
 
-        return noteNumberSemitone == noteMap.at(cleanedNoteName);
-    }
+            // As setDegreesByArray(): the distinct pitch classes, those below the lowest
+            // note's pitch class an octave up, in ascending order.
+            const int lowest = getLowestNote();
+            if (lowest >= 0)
+            {
+                const int lowestPitchClass = lowest % 12;
+                int numDegrees = 0;
+                for (int i = 0; i < 12 && numDegrees < 7; ++i)
+                {
+                    const int pitchClass = (lowestPitchClass + i) % 12;
+                    if (pitchClassCounts[pitchClass] != 0)
+                    {
+                        const int degree = pitchClass < lowestPitchClass ? pitchClass + 12 : pitchClass;
+                        value.degrees[numDegrees++] = (juce::int8)degree;
+                        value.degreeMask |= 1u << degree;
+                    }
+                }
+                value.root = value.degrees[0];
+                value.pitchClasses = PitchClassSet((juce::uint16)((value.degreeMask | (value.degreeMask >> 12)) & PitchClassSet::fullMask));
+            }
+
+            for (int word = 0; word < 2 && value.numRawNotes < ChordValue::maxRawNotes; ++word)
+                for (auto bits = occupancy[word]; bits != 0 && value.numRawNotes < ChordValue::maxRawNotes; bits &= bits - 1)
+                    value.rawNotes[value.numRawNotes++] = (juce::int16)(word * 64 + getLowestBit(bits));
+        }
+
+        juce::uint64 occupancy[2];                  // Bit n set while note n is held.
+        juce::uint8 previous[numNotes + 1];         // Insertion-order ring, linked through ringHead.
+        juce::uint8 next[numNotes + 1];
+        juce::uint8 pitchClassCounts[12];           // Held notes per pitch class.
+        PitchClassSet pitchClasses;
+        int numHeld = 0;
+        ChordValue value;
+    };
 
     /**
-        Parses a chord name and returns the MIDI note number of its root, ignoring octave.
-        @param chordName The chord name, e.g., "C", "Am", "G7", "F#5".
-        @return The semitone of the root note (0-11), or 0 (C) if parsing fails.
+        A scale detected by ScaleDetector.
     */
-    static int getRootNoteFromChord(const juce::String& chordName)
+    struct ScaleMatch
     {
-        juce::String input = chordName.trim();
-        if (input.isEmpty())
-            return 0;
+        int root = -1;                         // Pitch class of the scale's root, -1 until notes have been played.
+        Scale::Type type = Scale::Type::Major;
+        float confidence = 0.0f;               // 0-1: how much better the scale fits than any other set of notes.
 
-        juce::String rootNoteStr;
-        auto& noteMap = getNoteNameOffsetMap();
+        bool isValid() const { return root != -1; }
 
-        // Check for multi-character suffixes first
-        if (input.endsWith("M7") || input.endsWith("m7"))
+        /** Returns the detected scale. This allocates; on the audio thread use getDiatonicChordValue(). */
+        Scale getScale() const { return Scale(juce::jmax(0, root), type); }
+    };
+
+    /**
+        Infers the key and scale being played from the incoming notes, e.g. so that the
+        arpeggiator's "Single note" mode follows the music (see Arpeggiator::followScale()).
+
+        noteOn() and noteOff() update a pitch-class histogram in constant time: every note-on
+        adds a short accent and every held note adds its duration, and the whole histogram
+        decays with setHalfLife(). advance(), called once per block, applies the decay and
+        scores the histogram against every root and Scale::Type at once, as one matrix-vector
+        product over a precomputed weight table (a loop compilers vectorise). A scale scores
+        the weight of its notes minus that of the notes it lacks, with a bonus for matching
+        the Krumhansl-Kessler key profile (major or minor, by the scale's third) on its root,
+        which tells apart modes sharing the same notes, and a small penalty per scale note,
+        which prefers e.g. a pentatonic scale when only its notes are played.
+
+        The best match is published in one atomic word: noteOn(), noteOff(), advance() and
+        reset() must be called from a single thread (normally the audio thread) and never
+        allocate or lock; getMatch() can be called from any thread. The first detector
+        constructed builds the shared weight table, so construct them off the audio thread.
+    */
+    class ScaleDetector
+    {
+    public:
+        ScaleDetector()
         {
-            rootNoteStr = input.dropLastCharacters(2).toLowerCase();
+            WeightTable::getInstance(); // Built here rather than on the first advance() on the audio thread.
+            reset();
         }
-        else if (input.endsWith("7") || input.endsWith("5") || input.endsWith("m") || input.endsWith("M"))
+
+        /** Forgets every note. */
+        void reset()
         {
-            rootNoteStr = input.dropLastCharacters(1).toLowerCase();
+            std::fill(histogram.begin(), histogram.end(), 0.0f);
+            std::fill(std::begin(heldPitchClasses), std::end(heldPitchClasses), 0);
+            std::fill(std::begin(noteCounts), std::end(noteCounts), (juce::uint8)0);
+            current = -1;
+            histogramChanged = false;
+            published.store(0, std::memory_order_release);
         }
-        else // Assume single note
+
+        /** How fast older notes are forgotten: their weight halves every halfLifeSeconds. */
+        void setHalfLife(double halfLifeSeconds) { halfLife = juce::jmax(0.01, halfLifeSeconds); }
+
+        /**
+            How much better another scale must score to replace the current one, as a fraction
+            of the histogram's total weight. Avoids flickering between close candidates.
+        */
+        void setHysteresis(float fraction) { hysteresis = juce::jmax(0.0f, fraction); }
+
+        /** Adds a note, with a velocity from 0 to 1. */
+        void noteOn(int noteNumber, float velocity = 1.0f)
         {
-            rootNoteStr = input.toLowerCase();
+            if (! juce::isPositiveAndBelow(noteNumber, 128))
+                return;
+            histogram[(size_t)(noteNumber % 12)] += onsetWeight * juce::jlimit(0.0f, 1.0f, velocity);
+            if (noteCounts[noteNumber] < 0xff)
+            {
+                ++noteCounts[noteNumber];
+                ++heldPitchClasses[noteNumber % 12];
+            }
+            histogramChanged = true;
         }
 
-        // Handle sharp/flat in root note
-        if (rootNoteStr.length() > 1 && (rootNoteStr.endsWith("#") || rootNoteStr.endsWith("b")))
+        void noteOff(int noteNumber)
         {
-            // Already have the full root note string
+            if (! juce::isPositiveAndBelow(noteNumber, 128) || noteCounts[noteNumber] == 0)
+                return;
+            --noteCounts[noteNumber];
+            --heldPitchClasses[noteNumber % 12];
         }
-        else if (rootNoteStr.length() > 1) // e.g. "solb"
+
+        /** Advances time: decays the histogram, adds the held notes, then rescores and publishes the best scale. */
+        void advance(double seconds)
         {
-             // keep as is for french notation
+            if (seconds > 0.0)
+            {
+                const auto decay = (float)std::exp2(-seconds / halfLife);
+                const auto heldWeight = (float)(halfLife / std::log(2.0)) * (1.0f - decay); // Integral of the decay over the interval.
+                for (int pitchClass = 0; pitchClass < 12; ++pitchClass)
+                {
+                    histogram[(size_t)pitchClass] = histogram[(size_t)pitchClass] * decay + (float)heldPitchClasses[pitchClass] * heldWeight;
+                    histogramChanged |= heldPitchClasses[pitchClass] != 0;
+                }
+            }
+
+            if (histogramChanged)
+                rescore();
+            histogramChanged = false;
         }
-        else {
-            // single character root note
+
+        /** Returns the scale published by the last advance(). Lock-free; callable from any thread. */
+        ScaleMatch getMatch() const
+        {
+            return unpack(published.load(std::memory_order_acquire));
         }
 
-        if (noteMap.count(rootNoteStr))
-            return noteMap.at(rootNoteStr);
+        /** Returns the decayed weight of each pitch class (0 = C). */
+        const std::array<float, 12>& getHistogram() const { return histogram; }
 
-        return 0; // Default to C if parsing fails
-    }
+    private:
+        static constexpr int numCandidates = 12 * Scale::numTypes; // Candidate index: type * 12 + root.
+        static constexpr float onsetWeight = 0.1f;    // A note-on counts as 0.1 s of holding the note.
+        static constexpr float missingWeight = 1.0f;  // Penalty per unit of weight outside the scale.
+        static constexpr float profileWeight = 0.5f;  // Weight of the key-profile correlation.
+        static constexpr float sizeWeight = 0.02f;    // Penalty per scale note, per unit of total weight.
+
+        /** Score weights for every candidate scale, built once on first use. */
+        class WeightTable
+        {
+        public:
+            static const WeightTable& getInstance()
+            {
+                static const WeightTable table;
+                return table;
+            }
 
-    /**
-        Checks if a collection of MIDI notes forms a specific major or minor chord,
-        regardless of octave or inversion.
-        @param heldNotes          A collection of MIDI note numbers currently being played.
-        @param chordName          The chord to check for, e.g., "CM", "F#m", "Ebm".
-                                  Case-insensitive. 'M' or no suffix for major, 'm' for minor.
+            // weights[pitchClass][candidate], so that scoring runs along contiguous candidates.
+            alignas(32) std::array<std::array<float, numCandidates>, 12> weights {};
+            std::array<juce::uint16, numCandidates> pitchClassMasks {};
+
+        private:
+            WeightTable()
+            {
+                // Krumhansl-Kessler probe-tone ratings, from the tonic up.
+                static constexpr float majorProfile[12] = { 6.35f, 2.23f, 3.48f, 2.33f, 4.38f, 4.09f, 2.52f, 5.19f, 2.39f, 3.66f, 2.29f, 2.88f };
+                static constexpr float minorProfile[12] = { 6.33f, 2.68f, 3.52f, 5.38f, 2.60f, 3.53f, 2.54f, 4.75f, 3.98f, 2.69f, 3.34f, 3.17f };
+                float normalisedMajor[12], normalisedMinor[12];
+                normaliseProfile(majorProfile, normalisedMajor);
+                normaliseProfile(minorProfile, normalisedMinor);
+
+                for (int type = 0; type < Scale::numTypes; ++type)
+                {
+                    const auto intervals = Scale::scaleIntervals[type].getPitchClassSet();
+                    const bool hasMajorThird = intervals.contains(4), hasMinorThird = intervals.contains(3);
+
+                    for (int root = 0; root < 12; ++root)
+                    {
+                        const int candidate = type * 12 + root;
+                        const auto scale = intervals.transposed(root);
+                        pitchClassMasks[(size_t)candidate] = scale.mask;
+
+                        for (int pitchClass = 0; pitchClass < 12; ++pitchClass)
+                        {
+                            const int interval = (pitchClass - root + 12) % 12;
+                            const float profile = hasMajorThird == hasMinorThird ? 0.5f * (normalisedMajor[interval] + normalisedMinor[interval])
+                                                : hasMajorThird ? normalisedMajor[interval] : normalisedMinor[interval];
+                            weights[(size_t)pitchClass][(size_t)candidate] = (scale.contains(pitchClass) ? 1.0f : -missingWeight)
+                                                                             + profileWeight * profile
+                                                                             - sizeWeight * (float)intervals.size();
+                        }
+                    }
+                }
+            }
+
+            /** Scales a profile to zero mean and unit length. */
+            static void normaliseProfile(const float (&profile)[12], float (&result)[12])
+            {
+                float mean = 0.0f, length = 0.0f;
+                for (float value : profile)
+                    mean += value / 12.0f;
+                for (float value : profile)
+                    length += (value - mean) * (value - mean);
+                length = std::sqrt(length);
+                for (int i = 0; i < 12; ++i)
+                    result[i] = (profile[i] - mean) / length;
+            }
+        };
+
+        void rescore()
+        {
+            float total = 0.0f;
+            for (float weight : histogram)
+                total += weight;
+            if (total <= 1.0e-6f)
+                return;
+
+            const auto& table = WeightTable::getInstance();
+            alignas(32) float scores[numCandidates] {};
+            for (int pitchClass = 0; pitchClass < 12; ++pitchClass)
+            {
+                const float weight = histogram[(size_t)pitchClass];
+                if (weight == 0.0f)
+                    continue;
+                const float* row = table.weights[(size_t)pitchClass].data();
+                for (int candidate = 0; candidate < numCandidates; ++candidate)
+                    scores[candidate] += row[candidate] * weight;
+            }
+
+            int best = 0;
+            for (int candidate = 1; candidate < numCandidates; ++candidate)
+                if (scores[candidate] > scores[best])
+                    best = candidate;
+            if (current >= 0 && scores[current] >= scores[best] - hysteresis * total)
+                best = current;
+
+            float runnerUp = -std::numeric_limits<float>::max();
+            for (int candidate = 0; candidate < numCandidates; ++candidate)
+                if (table.pitchClassMasks[(size_t)candidate] != table.pitchClassMasks[(size_t)best])
+                    runnerUp = juce::jmax(runnerUp, scores[candidate]);
+
+            current = best;
+            const float confidence = juce::jlimit(0.0f, 1.0f, (scores[best] - runnerUp) / total);
+            published.store(pack(best % 12, best / 12, confidence), std::memory_order_release);
+        }
+
+        // Published as: bit 0 valid, bits 1-4 root, bits 5-9 type, bits 10-17 confidence.
+        static juce::uint32 pack(int root, int type, float confidence)
+        {
+            return 1u | (juce::uint32)root << 1 | (juce::uint32)type << 5 | (juce::uint32)juce::roundToInt(confidence * 255.0f) << 10;
+        }
+
+        static ScaleMatch unpack(juce::uint32 bits)
+        {
+            ScaleMatch match;
+            if ((bits & 1) == 0)
+                return match;
+            match.root = (int)((bits >> 1) & 0x0f);
+            match.type = (Scale::Type)((bits >> 5) & 0x1f);
+            match.confidence = (float)((bits >> 10) & 0xff) / 255.0f;
+            return match;
+        }
+
+        std::array<float, 12> histogram {};
+        int heldPitchClasses[12] {};
+        juce::uint8 noteCounts[128] {};
+        double halfLife = 4.0;
+        float hysteresis = 0.05f;
+        int current = -1; // Candidate published last, -1 if none.
+        bool histogramChanged = false;
+        std::atomic<juce::uint32> published { 0 };
+    };
+
+    /**
+        Returns a map of French note names (Do, Ré b, etc.) to their semitone offset from C.
+        Kept for compatibility: findNoteName() reads the same names without allocating.
+    */
+    static const std::map<juce::String, int>& getFrenchNoteNameOffsetMap()
+    {
+        static const std::map<juce::String, int> noteOffsets = makeNoteNameOffsetMap(NoteSpelling::french);
+        return noteOffsets;
+    }
+
+
+    /**
+        Converts a MIDI note number into its string representation (e.g., 60 -> "C4").
+        @param noteNumber The MIDI note number (0-127).
+        @return A string representing the note name and octave.
+    */
+    static juce::String getNoteName(int noteNumber)
+    {
+        if (noteNumber < 0 || noteNumber > 127)
+            return "Invalid";
+
+        static const juce::String noteNames[] = { "C", "C#", "D", "D#", "E", "F", "F#", "G", "G#", "A", "A#", "B" };
+
+        const int octave = (noteNumber / 12) - 1;
+        const juce::String& note = noteNames[noteNumber % 12];
+
+        return note + juce::String(octave);
+    }
+
+    /**
+        Converts a note name string (e.g., "C#4") into a MIDI note number.
+        Handles sharps (#), flats (b), octave numbers and every spelling findNoteName() knows. Case-insensitive.
+        @param noteNameWithOctave The note string, e.g., "C4", "Db-1", "f#5", "Sol3", "Fis2".
+        @return The MIDI note number (0-127), or -1 if the string is invalid.
+    */
+    static int getNoteNumber(const juce::String& noteNameWithOctave)
+    {
+        const std::string_view input(noteNameWithOctave.toRawUTF8(), noteNameWithOctave.getNumBytesAsUTF8());
+
+        // The octave starts at the first digit or minus sign.
+        size_t octaveStart = 0;
+        while (octaveStart < input.size() && input[octaveStart] != '-' && (input[octaveStart] < '0' || input[octaveStart] > '9'))
+            ++octaveStart;
+
+        const int noteOffset = findNoteName(input.substr(0, octaveStart));
+        if (noteOffset < 0)
+            return -1; // Note name not found
+
+        size_t end = input.size();
+        while (end > octaveStart && (input[end - 1] == ' ' || input[end - 1] == '\t'))
+            --end;
+
+        const bool isNegative = octaveStart < end && input[octaveStart] == '-';
+        size_t digit = octaveStart + (isNegative ? 1 : 0);
+        if (digit == end)
+            return -1; // Missing octave
+
+        int octave = 0;
+        for (; digit < end; ++digit)
+        {
+            if (input[digit] < '0' || input[digit] > '9' || octave > 10)
+                return -1; // Invalid or out of range octave
+            octave = octave * 10 + (input[digit] - '0');
+        }
+
+        const int midiNote = ((isNegative ? -octave : octave) + 1) * 12 + noteOffset;
+
+        if (midiNote >= 0 && midiNote <= 127)
+            return midiNote;
+
+        return -1; // Result is out of MIDI range
+    }
+
+    /**
+        Checks if a MIDI note number corresponds to a note name, ignoring the octave.
+        @param noteNumber The MIDI note number to check.
+        @param noteName   The note name to compare against (e.g., "C", "Db", "F#", "Ré"). Case-insensitive.
+        @return True if the note number's pitch class matches the note name, false otherwise.
+    */
+    static bool isNoteEqual(int noteNumber, const juce::String& noteName)
+    {
+        if (noteNumber < 0 || noteNumber > 127)
+            return false;
+
+        const int semitone = findNoteName(noteName);
+        return semitone >= 0 && noteNumber % 12 == semitone;
+    }
+
+    /**
+        Parses a chord name and returns the MIDI note number of its root, ignoring octave.
+        @param chordName The chord name, e.g., "C", "Am", "G7", "F#5", "Dbmaj7/F".
+        @return The semitone of the root note (0-11), or 0 (C) if parsing fails.
+    */
+    static int getRootNoteFromChord(const juce::String& chordName)
+    {
+        const auto symbol = parseChordSymbol(chordName);
+        return symbol.isValid() ? symbol.root : 0; // Default to C if parsing fails
+    }
+
+    /**
+        Checks if a collection of MIDI notes has exactly the given pitch classes,
+        regardless of octave or inversion.
+        @param heldNotes    A collection of MIDI note numbers currently being played.
+        @param targetChord  The pitch classes to compare against, e.g. Chord("Am").getPitchClassSet().
+                            Build it once and reuse it when checking many events against one chord.
+        @return True if the notes form the specified chord, false otherwise.
+    */
+    template <typename Collection>
+    static bool isChordEqual(const Collection& heldNotes, PitchClassSet targetChord)
+    {
+        if (targetChord.isEmpty())
+            return false;
+
+        PitchClassSet playedNotes;
+        for (const auto& noteNumber : heldNotes)
+        {
+            if (noteNumber < 0)
+                return false;
+            playedNotes = playedNotes.with(noteNumber);
+        }
+        return playedNotes == targetChord;
+    }
+
+    /**
+        Checks if a collection of MIDI notes forms a specific chord,
+        regardless of octave or inversion.
+        @param heldNotes          A collection of MIDI note numbers currently being played.
+        @param chordName          The chord to check for, e.g., "CM", "F#m", "Ebm", "G7b9", "C/Bb".
+                                  Any symbol parseChordSymbol() accepts; the root is case-insensitive.
+                                  The symbol is parsed without allocating.
         @return True if the notes form the specified chord, false otherwise.
     */
     template <typename Collection>
     static bool isChordEqual(const Collection& heldNotes, const juce::String& chordName)
     {
-        if (chordName.trim().isEmpty() || heldNotes.isEmpty())
+        if (heldNotes.isEmpty())
             return false;
-    
-        // 1. Create a Chord object to get the target semitones.
-        Chord targetChord(chordName);
-        juce::SortedSet<int> targetSemitones = targetChord.getSortedSet();
-    
-        // If the chord name was invalid, the set of target notes will be empty.
-        if (targetSemitones.isEmpty())
+
+        // The pitch classes Chord(chordName) would have, built without allocating.
+        const auto symbol = parseChordSymbol(chordName);
+        if (! symbol.isValid())
             return false;
-    
-        // 2. Build a set of the currently played semitones.
-        juce::SortedSet<int> playedSemitones;
+
+        auto targetChord = chordQualities[symbol.quality].getPitchClassSet().transposed(symbol.root);
+        if (symbol.bass >= 0)
+            targetChord = targetChord.with(symbol.bass);
+        return isChordEqual(heldNotes, targetChord);
+    }
+
+    /**
+        The result of identifying a chord from a set of notes. See identifyChord().
+    */
+    struct ChordMatch
+    {
+        int root = -1;      // Pitch class of the chord's root (0-11), -1 if nothing was identified.
+        int quality = -1;   // Index into chordQualities.
+        int bass = -1;      // Pitch class of the lowest note, -1 if unknown.
+        int inversion = 0;  // Degree slot of the bass note (0 = root position, 1 = third, ...), -1 if not a chord tone.
+
+        bool isValid() const { return root != -1; }
+
+        /** True when the bass is not the root, i.e. the chord is written "root/bass". */
+        bool isSlashChord() const { return isValid() && bass != -1 && bass != root; }
+
+        /** Returns the chord name in MidiTools nomenclature, e.g. "Am7", "CM/E" or "F#m7b5". */
+        juce::String getName() const
+        {
+            static const juce::String noteNames[] = { "C", "C#", "D", "D#", "E", "F", "F#", "G", "G#", "A", "A#", "B" };
+            if (! isValid())
+                return {};
+            juce::String name = noteNames[root] + chordQualities[quality].suffix;
+            return isSlashChord() ? name + "/" + noteNames[bass] : name;
+        }
+    };
+
+    /**
+        Precomputed best chord for every pitch-class set and bass pitch class.
+        Built once on first use; lookups are a single array read. Building it allocates
+        and takes a few milliseconds, so call getInstance() once off the audio thread
+        before identifying chords there (Arpeggiator::prepareToPlay() does).
+    */
+    class ChordIdentificationTable
+    {
+    public:
+        static const ChordIdentificationTable& getInstance()
+        {
+            static const ChordIdentificationTable table;
+            return table;
+        }
+
+        /**
+            Returns the best chord for a set of pitch classes.
+            @param notes    The pitch classes being played.
+            @param bassNote The lowest note being played (MIDI note or pitch class), or -1 if unknown.
+                            When given, chords rooted on the bass are preferred, and the bass
+                            decides the inversion and slash-chord spelling.
+        */
+        ChordMatch lookup(PitchClassSet notes, int bassNote = -1) const
+        {
+            ChordMatch match;
+            if (notes.isEmpty())
+                return match;
+
+            const int bass = bassNote >= 0 ? bassNote % 12 : -1;
+            const int column = notes.contains(bass) ? bass : 12;
+            const Entry entry = entries[(size_t)(notes.mask * 13 + column)];
+
+            match.root = entry.root;
+            match.quality = entry.quality;
+            match.bass = column < 12 ? bass : -1;
+            match.inversion = column < 12 ? entry.inversion : 0;
+            return match;
+        }
+
+    private:
+        struct Entry
+        {
+            juce::int8 root = -1;
+            juce::int8 quality = -1;
+            juce::int8 inversion = 0;
+        };
+
+        ChordIdentificationTable()
+        {
+            struct Candidate { int root; int quality; int score; };
+
+            for (int mask = 1; mask <= PitchClassSet::fullMask; ++mask)
+            {
+                const PitchClassSet notes((juce::uint16)mask);
+
+                // Score every (root, quality) pair with a played root: reward matched tones,
+                // penalise chord tones that are missing and played notes the chord lacks.
+                Candidate best[13];
+                for (auto& b : best)
+                    b = { -1, -1, std::numeric_limits<int>::min() };
+
+                for (int root = 0; root < 12; ++root)
+                {
+                    if (! notes.contains(root))
+                        continue;
+
+                    for (int quality = 0; quality < numChordQualities; ++quality)
+                    {
+                        const auto chordNotes = chordQualities[quality].getPitchClassSet().transposed(root);
+                        const int matched = notes.intersectionSize(chordNotes);
+                        const int missing = chordNotes.size() - matched;
+                        const int extra = notes.size() - matched;
+                        const int score = matched * 4 - missing * 3 - extra * 4;
+
+                        // Earlier qualities win ties, then lower roots.
+                        for (int column = 0; column <= 12; ++column)
+                        {
+                            if (column < 12 && ! notes.contains(column))
+                                continue;
+                            const int bassBonus = (column == root) ? 2 : (column < 12 && ! chordNotes.contains(column) ? -1 : 0);
+                            if (score + bassBonus > best[column].score)
+                                best[column] = { root, quality, score + bassBonus };
+                        }
+                    }
+                }
+
+                for (int column = 0; column <= 12; ++column)
+                {
+                    auto& entry = entries[(size_t)(mask * 13 + column)];
+                    entry.root = (juce::int8)best[column].root;
+                    entry.quality = (juce::int8)best[column].quality;
+                    entry.inversion = column < 12 && best[column].quality >= 0
+                                        ? (juce::int8)getInversion(best[column].root, best[column].quality, column) : 0;
+                }
+            }
+        }
+
+        static int getInversion(int root, int quality, int bass)
+        {
+            const int interval = (bass - root + 12) % 12;
+            for (int slot = 0; slot < 7; ++slot)
+            {
+                const int offset = chordQualities[quality].degrees[slot];
+                if (offset >= 0 && offset % 12 == interval)
+                    return slot;
+            }
+            return -1;
+        }
+
+        // 13 columns per pitch-class set: one per bass pitch class, then "bass unknown".
+        std::array<Entry, 4096 * 13> entries {};
+    };
+
+    /**
+        Identifies the chord formed by a set of pitch classes.
+        @param notes    The pitch classes being played.
+        @param bassNote The lowest note being played, or -1 if unknown.
+        @return The best matching chord; check ChordMatch::isValid() for empty input.
+    */
+    static ChordMatch identifyChord(PitchClassSet notes, int bassNote = -1)
+    {
+        return ChordIdentificationTable::getInstance().lookup(notes, bassNote);
+    }
+
+    /**
+        Identifies the chord formed by a collection of MIDI notes, using the lowest one as the bass.
+        This is the inverse of the Chord(const juce::String&) constructor, e.g. {64, 67, 72} gives "CM/E".
+        @param heldNotes A collection of MIDI note numbers currently being played.
+    */
+    template <typename Collection>
+    static ChordMatch identifyChord(const Collection& heldNotes)
+    {
+        PitchClassSet notes;
+        int bassNote = -1;
         for (const auto& noteNumber : heldNotes)
         {
-            playedSemitones.add(noteNumber % 12);
+            if (noteNumber < 0)
+                continue;
+            notes = notes.with(noteNumber);
+            if (bassNote == -1 || noteNumber < bassNote)
+                bassNote = noteNumber;
         }
-    
-        // --- 3. Compare the sets ---
-        return playedSemitones == targetSemitones;
+        return identifyChord(notes, bassNote);
     }
 
     /**
         Returns a random major or minor chord name string.
         Uses the same nomenclature as isChordEqual (e.g., "C#M", "Am").
+        @param random The generator to use. Defaults to one owned by the calling thread.
         @return A string representing a random chord.
     */
-    static juce::String getRandomChordName()
+    static juce::String getRandomChordName(FastRandom& random = getThreadRandom())
     {
         static const juce::String rootNotes[] = { "C", "C#", "D", "D#", "E", "F", "F#", "G", "G#", "A", "A#", "B" };
         
-        juce::Random& random = juce::Random::getSystemRandom();
-        
         // 1. Pick a random root note
         const juce::String& root = rootNotes[random.nextInt(12)];
         
@@ -683,42 +2032,39 @@ namespace MidiTools
     /**
         Returns a random single note name string (e.g., "C", "F#", "Bb").
         Note that "Bb" will be represented as "A#".
+        @param random The generator to use. Defaults to one owned by the calling thread.
         @return A string representing a random note name.
     */
-    static juce::String getRandomSingleNoteName()
+    static juce::String getRandomSingleNoteName(FastRandom& random = getThreadRandom())
     {
         static const juce::String noteNames[] = { "C", "C#", "D", "D#", "E", "F", "F#", "G", "G#", "A", "A#", "B" };
 
-        juce::Random& random = juce::Random::getSystemRandom();
-
         return noteNames[random.nextInt(12)];
     }
 
     /**
         Returns a random fifth interval name string (e.g., "C5", "F#5").
+        @param random The generator to use. Defaults to one owned by the calling thread.
         @return A string representing a random fifth interval.
     */
-    static juce::String getRandomFifthInterval()
+    static juce::String getRandomFifthInterval(FastRandom& random = getThreadRandom())
     {
         static const juce::String noteNames[] = { "C", "C#", "D", "D#", "E", "F", "F#", "G", "G#", "A", "A#", "B" };
 
-        juce::Random& random = juce::Random::getSystemRandom();
-
         const juce::String& root = noteNames[random.nextInt(12)];
         return root + "5";
     }
 
     /**
         Returns a random 7th chord name string (e.g., "CM7", "Am7", "G7").
+        @param random The generator to use. Defaults to one owned by the calling thread.
         @return A string representing a random 7th chord.
     */
-    static juce::String getRandomSeventhChord()
+    static juce::String getRandomSeventhChord(FastRandom& random = getThreadRandom())
     {
         static const juce::String rootNotes[] = { "C", "C#", "D", "D#", "E", "F", "F#", "G", "G#", "A", "A#", "B" };
         static const juce::String chordTypes[] = { "M7", "m7", "7" };
 
-        juce::Random& random = juce::Random::getSystemRandom();
-
         // 1. Pick a random root note
         const juce::String& root = rootNotes[random.nextInt(12)];
 
@@ -737,75 +2083,171 @@ namespace MidiTools
     {
         static const juce::String frenchNoteNames[] = { "Do", "Do#", "Re", "Re#", "Mi", "Fa", "Fa#", "Sol", "Sol#", "La", "La#", "Si" };
 
-        auto& noteMap = getNoteNameOffsetMap();
-        auto cleanedName = standardNoteName.trim().toLowerCase();
-
-        if (noteMap.count(cleanedName))
-        {
-            int semitone = noteMap.at(cleanedName);
-            return frenchNoteNames[semitone];
-        }
-        return {}; // Return empty string if not found
+        const int semitone = findNoteName(standardNoteName);
+        return semitone >= 0 ? frenchNoteNames[semitone] : juce::String(); // Return empty string if not found
     }
 
     /**
         Converts a standard international chord name (e.g., "C", "Am", "G5") to its French equivalent.
+        The root and slash bass are translated and the quality keeps its spelling, e.g. "Bbm7/F" gives "La#m7/Fa".
         @param standardChordName The standard chord name.
         @return The corresponding French chord name as a string. Returns the original name if it can't be parsed.
     */
     static juce::String getFrenchChordName(const juce::String& standardChordName)
     {
-        juce::String input = standardChordName.trim();
-        if (input.isEmpty())
+        static const juce::String frenchNoteNames[] = { "Do", "Do#", "Re", "Re#", "Mi", "Fa", "Fa#", "Sol", "Sol#", "La", "La#", "Si" };
+
+        if (standardChordName.trim().isEmpty())
             return {};
 
-        juce::String rootNoteStr;
-        juce::String suffix;
+        const auto symbol = parseChordSymbol(standardChordName);
+        if (! symbol.isValid())
+            return standardChordName;
 
-        // Check for longer suffixes first
-        if (input.endsWith("M7"))
-        {
-            rootNoteStr = input.dropLastCharacters(2);
-            suffix = "M7"; // e.g., "DoM7"
-        }
-        else if (input.endsWith("m7"))
-        {
-            rootNoteStr = input.dropLastCharacters(2);
-            suffix = "m7"; // e.g., "Lam7"
-        }
-        else if (input.endsWith("7"))
+        const char* utf8 = standardChordName.toRawUTF8();
+        juce::String frenchName = frenchNoteNames[symbol.root]
+                                + juce::String::fromUTF8(utf8 + symbol.qualityStart, symbol.qualityEnd - symbol.qualityStart);
+        if (symbol.bass >= 0)
+            frenchName += "/" + frenchNoteNames[symbol.bass];
+        return frenchName;
+    }
+
+    /** How euclideanMask() spreads hits over steps. */
+    enum class EuclideanAlgorithm
+    {
+        bresenham, // Step i is a hit when (i * hits) % steps < hits, as euclidianRythm() always did.
+        bjorklund  // Bjorklund's algorithm, as in Toussaint's paper: E(5,8) is x.xx.xx. rather than x.x.xx.x.
+    };
+
+    /** Returns a mask with the first 'steps' bits set (0-64 steps). */
+    static constexpr juce::uint64 getStepsMask(int steps)
+    {
+        return steps >= 64 ? ~(juce::uint64)0 : steps <= 0 ? 0 : (((juce::uint64)1 << steps) - 1);
+    }
+
+    /**
+        Rotates a rhythm of 'steps' steps (bit i = step i) so that step i moves to step i + rotation.
+        Negative rotations move steps earlier.
+    */
+    static constexpr juce::uint64 rotateSteps(juce::uint64 mask, int steps, int rotation)
+    {
+        if (steps <= 0 || steps > 64)
+            return 0;
+        mask &= getStepsMask(steps);
+        const int shift = ((rotation % steps) + steps) % steps;
+        if (shift == 0)
+            return mask;
+        return ((mask << shift) | (mask >> (steps - shift))) & getStepsMask(steps);
+    }
+
+    /**
+        Computes a Euclidean rhythm as a bit mask, bit i set when step i is a hit.
+        Prefer euclideanMask(), which reads a precomputed table.
+        @param hits  The number of hits, clamped to 0-steps.
+        @param steps The number of steps, 1-64. Returns 0 otherwise.
+    */
+    static constexpr juce::uint64 computeEuclideanMask(int hits, int steps, EuclideanAlgorithm algorithm)
+    {
+        if (steps <= 0 || steps > 64)
+            return 0;
+        if (hits <= 0)
+            return 0;
+        if (hits >= steps)
+            return getStepsMask(steps);
+
+        if (algorithm == EuclideanAlgorithm::bresenham)
         {
-            rootNoteStr = input.dropLastCharacters(1);
-            suffix = "7"; // e.g., "Sol7"
+            juce::uint64 mask = 0;
+            for (int i = 0, remainder = 0; i < steps; ++i, remainder = (remainder + hits) % steps)
+                if (remainder < hits)
+                    mask |= (juce::uint64)1 << i;
+            return mask;
         }
-        else if (input.endsWith("5"))
+
+        // Bjorklund: start with 'hits' groups "1" and 'steps - hits' groups "0", then repeatedly
+        // append one trailing group to each leading group. All leading groups stay identical and
+        // so do all trailing ones, so each kind is one (bits, length) pair with a count.
+        juce::uint64 a = 1, b = 0;
+        int lengthA = 1, lengthB = 1;
+        int countA = hits, countB = steps - hits;
+        while (countB > 1)
         {
-            rootNoteStr = input.dropLastCharacters(1);
-            suffix = "5"; // e.g., "Sol5"
+            const int paired = countA < countB ? countA : countB;
+            const int remaining = (countA > countB ? countA : countB) - paired;
+            const juce::uint64 merged = a | (b << lengthA);
+            const int mergedLength = lengthA + lengthB;
+            if (countA > countB)
+            {
+                b = a;
+                lengthB = lengthA;
+            }
+            a = merged;
+            lengthA = mergedLength;
+            countA = paired;
+            countB = remaining;
         }
-        else if (input.endsWith("m"))
+
+        juce::uint64 mask = 0;
+        int position = 0;
+        for (int i = 0; i < countA; ++i, position += lengthA)
+            mask |= a << position;
+        for (int i = 0; i < countB; ++i, position += lengthB)
+            mask |= b << position;
+        return mask;
+    }
+
+    /**
+        Every Euclidean rhythm of up to 64 steps, for both algorithms. Built once on first use
+        (about 34 KB); lookups are a single array read.
+    */
+    class EuclideanTable
+    {
+    public:
+        static const EuclideanTable& getInstance()
         {
-            rootNoteStr = input.dropLastCharacters(1);
-            suffix = "m";
+            static const EuclideanTable table;
+            return table;
         }
-        else if (input.endsWith("M"))
+
+        /** Same as computeEuclideanMask(). */
+        juce::uint64 getMask(int hits, int steps, EuclideanAlgorithm algorithm) const noexcept
         {
-            rootNoteStr = input.dropLastCharacters(1);
-            suffix = "M";
+            if (steps <= 0 || steps > 64)
+                return 0;
+            hits = juce::jlimit(0, steps, hits);
+            return masks[(size_t)algorithm][(size_t)(steps * (steps + 1) / 2 + hits)];
         }
-        else // Handles single notes ("C")
+
+    private:
+        EuclideanTable()
         {
-            rootNoteStr = input;
-            suffix = ""; // This case now only handles single notes.
+            for (int algorithm = 0; algorithm < 2; ++algorithm)
+                for (int steps = 0; steps <= 64; ++steps)
+                    for (int hits = 0; hits <= steps; ++hits)
+                        masks[(size_t)algorithm][(size_t)(steps * (steps + 1) / 2 + hits)]
+                            = computeEuclideanMask(hits, steps, (EuclideanAlgorithm)algorithm);
         }
 
-        juce::String frenchRoot = getFrenchNoteName(rootNoteStr);
-        return frenchRoot.isNotEmpty() ? frenchRoot + suffix : standardChordName;
+        // Row 'steps' holds steps + 1 entries, one per number of hits.
+        std::array<std::array<juce::uint64, 65 * 66 / 2>, 2> masks {};
+    };
+
+    /**
+        Returns a Euclidean rhythm as a bit mask (bit i set when step i is a hit) without allocating.
+        @param hits      The number of hits, clamped to 0-steps.
+        @param steps     The number of steps, 1-64. Returns 0 otherwise.
+        @param rotation  Moves every hit this many steps later, wrapping around.
+    */
+    static juce::uint64 euclideanMask(int hits, int steps, int rotation = 0,
+                                      EuclideanAlgorithm algorithm = EuclideanAlgorithm::bresenham)
+    {
+        return rotateSteps(EuclideanTable::getInstance().getMask(hits, steps, algorithm), steps, rotation);
     }
 
     /**
         Generates a Euclidean rhythm using a Bresenham-based algorithm.
         This distributes 'hits' pulses as evenly as possible over 'steps'.
+        Up to 64 steps, euclideanMask() gives the same rhythm without allocating.
         @param hits The number of active steps (pulses).
         @param steps The total number of steps.
         @return A juce::Array<bool> where true represents a hit and false a rest.
@@ -816,6 +2258,15 @@ namespace MidiTools
         if (steps <= 0) return pattern;
         
         hits = juce::jlimit(0, steps, hits);
+        pattern.ensureStorageAllocated(steps);
+
+        if (steps <= 64)
+        {
+            const auto mask = euclideanMask(hits, steps, rotation);
+            for (int i = 0; i < steps; ++i)
+                pattern.add(((mask >> i) & 1) != 0);
+            return pattern;
+        }
 
         for (int i = 0; i < steps; ++i)
         {
@@ -826,4 +2277,873 @@ namespace MidiTools
 
         return pattern;
     }
+
+    /**
+        A fixed-capacity queue of events ordered by sample time, e.g. scheduled note-offs.
+        Stored as a binary min-heap in a plain array, so scheduling and draining never
+        allocate and cost O(log n) whatever the number of pending events.
+        @tparam Event A copyable type with a juce::int64 'time' member, in absolute samples
+                      counted by the owner.
+    */
+    template <typename Event, int Capacity>
+    class TimedEventQueue
+    {
+    public:
+        static constexpr int capacity = Capacity;
+
+        bool isEmpty() const noexcept { return numPending == 0; }
+        bool isFull() const noexcept  { return numPending == Capacity; }
+        int size() const noexcept     { return numPending; }
+
+        /** Returns the earliest pending event. The queue must not be empty. */
+        const Event& top() const noexcept
+        {
+            jassert(numPending > 0);
+            return heap[0];
+        }
+
+        /** Adds an event. The queue must not be full. */
+        void push(const Event& event) noexcept
+        {
+            jassert(numPending < Capacity);
+            if (numPending == Capacity)
+                return;
+
+            const int i = numPending++;
+            heap[(size_t)i] = event;
+            siftUp(i);
+        }
+
+        /** Removes and returns the earliest pending event. The queue must not be empty. */
+        Event pop() noexcept
+        {
+            jassert(numPending > 0);
+            const Event earliest = heap[0];
+            removeAt(0);
+            return earliest;
+        }
+
+        /**
+            Removes the first pending event for which predicate(event) returns true, e.g. the
+            note-off of a note being retriggered, which would otherwise cut the new note short.
+            @return true if an event was removed.
+        */
+        template <typename Predicate>
+        bool removeFirst(Predicate&& predicate) noexcept
+        {
+            for (int i = 0; i < numPending; ++i)
+            {
+                if (predicate(heap[(size_t)i]))
+                {
+                    removeAt(i);
+                    return true;
+                }
+            }
+            return false;
+        }
+
+        void clear() noexcept { numPending = 0; }
+
+    private:
+        void removeAt(int i) noexcept
+        {
+            heap[(size_t)i] = heap[(size_t)--numPending];
+            if (i < numPending)
+            {
+                siftDown(i);
+                siftUp(i);
+            }
+        }
+
+        void siftUp(int i) noexcept
+        {
+            while (i > 0)
+            {
+                const int parent = (i - 1) / 2;
+                if (heap[(size_t)parent].time <= heap[(size_t)i].time)
+                    break;
+                std::swap(heap[(size_t)parent], heap[(size_t)i]);
+                i = parent;
+            }
+        }
+
+        void siftDown(int i) noexcept
+        {
+            for (;;)
+            {
+                const int left = 2 * i + 1;
+                const int right = left + 1;
+                int earliest = i;
+                if (left < numPending && heap[(size_t)left].time < heap[(size_t)earliest].time)
+                    earliest = left;
+                if (right < numPending && heap[(size_t)right].time < heap[(size_t)earliest].time)
+                    earliest = right;
+                if (earliest == i)
+                    break;
+                std::swap(heap[(size_t)earliest], heap[(size_t)i]);
+                i = earliest;
+            }
+        }
+
+        std::array<Event, (size_t)Capacity> heap {};
+        int numPending = 0;
+    };
+
+    /**
+        Streams MIDI events into a type-0 Standard MIDI File, without building a
+        juce::MidiMessageSequence first. Events must be added in time order.
+        Reuse one writer for many files: reset() keeps the allocated memory.
+    */
+    class MidiFileWriter
+    {
+    public:
+        explicit MidiFileWriter(int ticksPerQuarterNote = 960)
+            : ticksPerQuarter(juce::jlimit(1, 0x7fff, ticksPerQuarterNote))
+        {
+        }
+
+        int getTicksPerQuarterNote() const { return ticksPerQuarter; }
+
+        /** Starts a new file. */
+        void reset()
+        {
+            track.reset();
+            lastTick = 0;
+        }
+
+        /** Adds a tempo change. */
+        void addTempo(juce::int64 tick, double tempoBPM)
+        {
+            const auto microsecondsPerQuarter = (juce::uint32)juce::jlimit(1.0, (double)0xffffff, std::round(60000000.0 / tempoBPM));
+            writeDeltaTime(tick);
+            const juce::uint8 tempoEvent[] = { 0xff, 0x51, 0x03,
+                                               (juce::uint8)(microsecondsPerQuarter >> 16),
+                                               (juce::uint8)(microsecondsPerQuarter >> 8),
+                                               (juce::uint8)microsecondsPerQuarter };
+            track.write(tempoEvent, sizeof(tempoEvent));
+        }
+
+        /** Adds a channel message, e.g. the data of a juce::MidiMessage. */
+        void addEvent(juce::int64 tick, const juce::uint8* data, int numBytes)
+        {
+            writeDeltaTime(tick);
+            track.write(data, (size_t)numBytes);
+        }
+
+        /**
+            Writes the file: the header chunk, then the track ending at endTick.
+            @return false if writing to the stream failed.
+        */
+        bool writeTo(juce::OutputStream& out, juce::int64 endTick)
+        {
+            const auto trackEnd = juce::jmax(endTick, lastTick);
+            juce::uint8 endOfTrack[8];
+            int endOfTrackSize = writeVariableLength(endOfTrack, (juce::uint32)(trackEnd - lastTick));
+            endOfTrack[endOfTrackSize++] = 0xff;
+            endOfTrack[endOfTrackSize++] = 0x2f;
+            endOfTrack[endOfTrackSize++] = 0x00;
+
+            return out.write("MThd", 4)
+                && out.writeIntBigEndian(6)
+                && out.writeShortBigEndian(0) // Type 0: a single track.
+                && out.writeShortBigEndian(1)
+                && out.writeShortBigEndian((short)ticksPerQuarter)
+                && out.write("MTrk", 4)
+                && out.writeIntBigEndian((int)(track.getDataSize() + (size_t)endOfTrackSize))
+                && out.write(track.getData(), track.getDataSize())
+                && out.write(endOfTrack, (size_t)endOfTrackSize);
+        }
+
+    private:
+        void writeDeltaTime(juce::int64 tick)
+        {
+            jassert(tick >= lastTick); // Events must be added in time order.
+            const auto delta = (juce::uint32)juce::jmax((juce::int64)0, tick - lastTick);
+            lastTick = juce::jmax(lastTick, tick);
+
+            juce::uint8 bytes[5];
+            track.write(bytes, (size_t)writeVariableLength(bytes, delta));
+        }
+
+        /** Encodes a delta time as an SMF variable-length quantity; returns the number of bytes. */
+        static int writeVariableLength(juce::uint8* dest, juce::uint32 value)
+        {
+            value = juce::jmin(value, (juce::uint32)0x0fffffff);
+            int numBytes = 1;
+            for (auto v = value >> 7; v != 0; v >>= 7)
+                ++numBytes;
+
+            for (int i = numBytes - 1; i >= 0; --i)
+            {
+                dest[i] = (juce::uint8)((value & 0x7f) | (i == numBytes - 1 ? 0 : 0x80));
+                value >>= 7;
+            }
+            return numBytes;
+        }
+
+        juce::MemoryOutputStream track;
+        int ticksPerQuarter;
+        juce::int64 lastTick = 0;
+    };
+
+    /**
+        One entry of a chord timeline: the chord sounding from tick on, until the next entry.
+        This is also the 8-byte record written by ChordTimelineAnalyser::writeTimeline().
+    */
+    struct ChordTimelineEntry
+    {
+        juce::uint32 tick = 0;          // In the ticks of the analysed file.
+        juce::uint16 pitchClasses = 0;  // PitchClassSet mask of the notes, 0 for silence.
+        juce::uint8 rootAndBass = 0xff; // Root pitch class in the low nibble, bass in the high nibble; 0xf if none.
+        juce::int8 quality = -1;        // Index into chordQualities, -1 for silence.
+
+        int getRoot() const { return (rootAndBass & 0x0f) < 12 ? (rootAndBass & 0x0f) : -1; }
+        int getBass() const { return (rootAndBass >> 4) < 12 ? (rootAndBass >> 4) : -1; }
+        PitchClassSet getPitchClassSet() const { return PitchClassSet(pitchClasses); }
+
+        /** Returns the chord as identifyChord() names it, with its inversion. */
+        ChordMatch getMatch() const { return identifyChord(getPitchClassSet(), getBass()); }
+    };
+
+    static_assert(sizeof(ChordTimelineEntry) == 8, "ChordTimelineEntry is a file record");
+
+    /**
+        Reads a Standard MIDI File in memory and reduces it to a chord timeline, for
+        harmonic analysis of large MIDI corpora. Events are read straight from the file
+        data, merging the tracks in time order; the sounding notes are sliced by beat or
+        by onset and every slice is named through the ChordIdentificationTable, so no
+        strings are built. Consecutive slices with the same chord are merged.
+        Reuse one analyser for many files: after the first few, analyse() no longer allocates.
+        See ChordCorpusScanner for running it over many files at once.
+    */
+    class ChordTimelineAnalyser
+    {
+    public:
+        enum class Slicing
+        {
+            beats, // One chord per slice of beatsPerSlice quarter notes, from every note sounding in it.
+            onsets // One chord per group of note-ons, from the notes sounding once the group is complete.
+        };
+
+        struct Options
+        {
+            Slicing slicing = Slicing::beats;
+            double beatsPerSlice = 1.0;         // Slicing::beats.
+            double onsetWindowBeats = 1.0 / 16; // Slicing::onsets: note-ons closer than this form one group.
+            bool ignoreDrums = true;            // Skips channel 10.
+        };
+
+        ChordTimelineAnalyser() = default;
+        explicit ChordTimelineAnalyser(const Options& analysisOptions) : options(analysisOptions) {}
+
+        void setOptions(const Options& newOptions) { options = newOptions; }
+        const Options& getOptions() const { return options; }
+
+        /**
+            Builds the chord timeline of a MIDI file, replacing the previous one.
+            A damaged track is read up to the damage.
+            @return false if the data does not start with a MIDI file header.
+        */
+        bool analyse(const void* fileData, size_t fileSize)
+        {
+            timeline.clearQuick();
+            tracks.clearQuick();
+            numNoteOns = 0;
+
+            const auto* data = static_cast<const juce::uint8*>(fileData);
+            const auto* end = data + fileSize;
+            if (fileSize < 14 || std::memcmp(data, "MThd", 4) != 0 || readBigEndian(data + 4, 4) < 6)
+                return false;
+
+            const int division = (int)readBigEndian(data + 12, 2);
+            if ((division & 0x8000) != 0) // SMPTE: sliced as if at 120 BPM.
+                ticksPerQuarter = juce::jmax(1, -(int)(juce::int8)(division >> 8) * (division & 0xff) / 2);
+            else
+                ticksPerQuarter = juce::jmax(1, division);
+
+            for (const auto* chunk = data + 8 + readBigEndian(data + 4, 4); end - chunk >= 8;)
+            {
+                const auto chunkSize = juce::jmin((size_t)readBigEndian(chunk + 4, 4), (size_t)(end - chunk - 8));
+                if (std::memcmp(chunk, "MTrk", 4) == 0)
+                {
+                    TrackCursor track { chunk + 8, chunk + 8 + chunkSize };
+                    if (track.readDeltaTime())
+                        tracks.add(track);
+                }
+                chunk += 8 + chunkSize;
+            }
+
+            startSlicing();
+            for (TrackCursor* next = nullptr;;)
+            {
+                // Merge the tracks: play the earliest pending event; ties go to the first track,
+                // which keeps playing while its events share a tick.
+                if (next == nullptr || next->finished || next->tick != (juce::uint64)currentTick)
+                {
+                    next = nullptr;
+                    for (auto& track : tracks)
+                        if (! track.finished && (next == nullptr || track.tick < next->tick))
+                            next = &track;
+                    if (next == nullptr)
+                        break;
+                }
+
+                advanceTo(next->tick);
+                readEvent(*next);
+                if (! next->finished)
+                    next->finished = ! next->readDeltaTime();
+            }
+            finishSlicing();
+            return true;
+        }
+
+        /** The timeline built by the last analyse(), sorted by tick. */
+        const juce::Array<ChordTimelineEntry>& getTimeline() const { return timeline; }
+
+        /** The resolution of the analysed file, which the timeline ticks are in. */
+        int getTicksPerQuarterNote() const { return ticksPerQuarter; }
+
+        /** The number of note-ons read by the last analyse(). */
+        int getNumNoteOns() const { return numNoteOns; }
+
+        /**
+            Writes the timeline as a compact binary file: "CHTL", then little-endian uint16
+            version (1), uint16 ticks per quarter note and uint32 number of entries, then one
+            8-byte ChordTimelineEntry per entry (uint32 tick, uint16 pitch classes,
+            uint8 root | bass << 4, int8 quality).
+            @return false if writing to the stream failed.
+        */
+        bool writeTimeline(juce::OutputStream& out) const
+        {
+            if (! (out.write("CHTL", 4) && out.writeShort(1) && out.writeShort((short)ticksPerQuarter)
+                   && out.writeInt(timeline.size())))
+                return false;
+
+            juce::uint8 records[256 * sizeof(ChordTimelineEntry)];
+            for (int first = 0; first < timeline.size(); first += 256)
+            {
+                const int count = juce::jmin(256, timeline.size() - first);
+                for (int i = 0; i < count; ++i)
+                {
+                    const auto& entry = timeline.getReference(first + i);
+                    auto* record = records + i * sizeof(ChordTimelineEntry);
+                    for (int byte = 0; byte < 4; ++byte)
+                        record[byte] = (juce::uint8)(entry.tick >> (8 * byte));
+                    record[4] = (juce::uint8)entry.pitchClasses;
+                    record[5] = (juce::uint8)(entry.pitchClasses >> 8);
+                    record[6] = entry.rootAndBass;
+                    record[7] = (juce::uint8)entry.quality;
+                }
+                if (! out.write(records, (size_t)count * sizeof(ChordTimelineEntry)))
+                    return false;
+            }
+            return true;
+        }
+
+    private:
+        /** A read position in one track chunk. */
+        struct TrackCursor
+        {
+            const juce::uint8* position = nullptr;
+            const juce::uint8* end = nullptr;
+            juce::uint64 tick = 0; // Time of the event at position.
+            juce::uint8 runningStatus = 0;
+            bool finished = false;
+
+            /** Reads a variable-length quantity; returns false past the end of the track. */
+            bool readVariableLength(juce::uint32& value)
+            {
+                value = 0;
+                for (int i = 0; i < 4 && position < end; ++i)
+                {
+                    const auto byte = *position++;
+                    value = (value << 7) | (byte & 0x7f);
+                    if ((byte & 0x80) == 0)
+                        return true;
+                }
+                return false;
+            }
+
+            bool readDeltaTime()
+            {
+                juce::uint32 delta = 0;
+                if (! readVariableLength(delta) || position >= end)
+                    return false;
+                tick += delta;
+                return true;
+            }
+
+            bool skip(juce::uint32 numBytes)
+            {
+                if ((size_t)(end - position) < numBytes)
+                    return false;
+                position += numBytes;
+                return true;
+            }
+        };
+
+        static juce::uint32 readBigEndian(const juce::uint8* bytes, int numBytes)
+        {
+            juce::uint32 value = 0;
+            for (int i = 0; i < numBytes; ++i)
+                value = (value << 8) | bytes[i];
+            return value;
+        }
+
+        /** Reads the event at the cursor, which must be at an event. Marks the track finished at its end or on damage. */
+        void readEvent(TrackCursor& track)
+        {
+            auto status = *track.position;
+            if ((status & 0x80) != 0)
+                ++track.position;
+            else if (track.runningStatus != 0)
+                status = track.runningStatus;
+            else
+            {
+                track.finished = true;
+                return;
+            }
+
+            juce::uint32 length = 0;
+            if (status == 0xff) // Meta event
+            {
+                if (track.position >= track.end)
+                {
+                    track.finished = true;
+                    return;
+                }
+                const auto type = *track.position++;
+                track.finished = type == 0x2f || ! track.readVariableLength(length) || ! track.skip(length);
+                return;
+            }
+            if (status == 0xf0 || status == 0xf7) // SysEx
+            {
+                track.runningStatus = 0;
+                track.finished = ! track.readVariableLength(length) || ! track.skip(length);
+                return;
+            }
+            if (status >= 0xf0 || track.end - track.position < ((status & 0xe0) == 0xc0 ? 1 : 2))
+            {
+                track.finished = true;
+                return;
+            }
+
+            track.runningStatus = status;
+            const auto* bytes = track.position;
+            track.position += (status & 0xe0) == 0xc0 ? 1 : 2;
+
+            const int channel = status & 0x0f;
+            if (options.ignoreDrums && channel == 9)
+                return;
+
+            const int note = bytes[0] & 0x7f;
+            if ((status & 0xf0) == 0x90 && bytes[1] != 0)
+                noteOn(channel, note);
+            else if ((status & 0xf0) == 0x80 || (status & 0xf0) == 0x90)
+                noteOff(channel, note);
+        }
+
+        void noteOn(int channel, int note)
+        {
+            ++numNoteOns;
+            auto& count = channelNoteCounts[channel][note];
+            if (count < 0xff && count++ == 0 && noteCounts[note]++ == 0)
+                sounding[note >> 6] |= (juce::uint64)1 << (note & 63);
+
+            const auto bit = (juce::uint64)1 << (note & 63);
+            if (options.slicing == Slicing::beats)
+            {
+                sliceNotes[note >> 6] |= bit;
+            }
+            else
+            {
+                silenceTick = -1;
+                if (groupTick < 0)
+                {
+                    groupTick = currentTick;
+                    groupNotes[0] = groupNotes[1] = 0;
+                }
+                groupNotes[note >> 6] |= bit;
+            }
+        }
+
+        void noteOff(int channel, int note)
+        {
+            auto& count = channelNoteCounts[channel][note];
+            if (count == 0 || --count != 0 || --noteCounts[note] != 0)
+                return;
+            sounding[note >> 6] &= ~((juce::uint64)1 << (note & 63));
+
+            // Released as the slice starts: it was seeded from the previous slice but does not
+            // sound in this one. Struck again on this tick, noteOn() adds it back.
+            if (options.slicing == Slicing::beats && currentTick == currentSlice * sliceTicks)
+                sliceNotes[note >> 6] &= ~((juce::uint64)1 << (note & 63));
+
+            // Silence, unless notes start again on the same tick. Within an onset group, it
+            // follows the group's chord once the group is closed.
+            if (options.slicing == Slicing::onsets && (sounding[0] | sounding[1]) == 0)
+            {
+                lastReleaseTick = currentTick;
+                if (groupTick < 0)
+                    silenceTick = currentTick;
+            }
+        }
+
+        void startSlicing()
+        {
+            std::memset(channelNoteCounts, 0, sizeof(channelNoteCounts));
+            std::memset(noteCounts, 0, sizeof(noteCounts));
+            sounding[0] = sounding[1] = sliceNotes[0] = sliceNotes[1] = 0;
+            sliceTicks = juce::jmax((juce::int64)1, (juce::int64)std::llround(options.beatsPerSlice * ticksPerQuarter));
+            onsetWindowTicks = juce::jmax((juce::int64)1, (juce::int64)std::llround(options.onsetWindowBeats * ticksPerQuarter));
+            currentSlice = 0;
+            currentTick = 0;
+            groupTick = -1;
+            silenceTick = -1;
+            lastReleaseTick = -1;
+        }
+
+        /** Closes the slices or onset group ending before an event at tick. */
+        void advanceTo(juce::uint64 tick)
+        {
+            currentTick = (juce::int64)juce::jmin(tick, (juce::uint64)std::numeric_limits<juce::uint32>::max());
+
+            if (options.slicing == Slicing::beats)
+            {
+                const auto slice = currentTick / sliceTicks;
+                if (slice == currentSlice)
+                    return;
+                addEntry(currentSlice * sliceTicks, sliceNotes);
+                if (slice > currentSlice + 1) // Slices without events hold the sounding notes.
+                    addEntry((currentSlice + 1) * sliceTicks, sounding);
+                currentSlice = slice;
+                sliceNotes[0] = sounding[0];
+                sliceNotes[1] = sounding[1];
+            }
+            else
+            {
+                if (groupTick >= 0 && currentTick >= groupTick + onsetWindowTicks)
+                    closeOnsetGroup();
+                if (silenceTick >= 0 && currentTick > silenceTick)
+                    addSilence();
+            }
+        }
+
+        void finishSlicing()
+        {
+            if (options.slicing == Slicing::beats)
+            {
+                addEntry(currentSlice * sliceTicks, sliceNotes);
+                return;
+            }
+            if (groupTick >= 0)
+                closeOnsetGroup();
+            if (silenceTick >= 0)
+                addSilence();
+        }
+
+        void addSilence()
+        {
+            const juce::uint64 none[2] = {};
+            addEntry(silenceTick, none);
+            silenceTick = -1;
+        }
+
+        void closeOnsetGroup()
+        {
+            const juce::uint64 notes[2] = { groupNotes[0] | sounding[0], groupNotes[1] | sounding[1] };
+            const bool released = (sounding[0] | sounding[1]) == 0;
+
+            // A group released on its first tick never sounded; the silence simply goes on.
+            if (! released || lastReleaseTick > groupTick)
+                addEntry(groupTick, notes);
+
+            // Released within the onset window: the silence starts at the last release.
+            if (released)
+                silenceTick = juce::jmax(lastReleaseTick, groupTick);
+            groupTick = -1;
+        }
+
+        /** Names the chord of a 128-note mask and appends it, unless it repeats the last entry. */
+        void addEntry(juce::int64 tick, const juce::uint64 (&notes)[2])
+        {
+            PitchClassSet pitchClasses;
+            int bassNote = -1;
+            for (int word = 0; word < 2; ++word)
+            {
+                for (auto bits = notes[word]; bits != 0; bits &= bits - 1)
+                {
+                    const int note = word * 64 + juce::countNumberOfBits((bits & (~bits + 1)) - 1);
+                    pitchClasses = pitchClasses.with(note);
+                    if (bassNote < 0)
+                        bassNote = note;
+                }
+            }
+
+            if (pitchClasses.isEmpty() && timeline.isEmpty()) // Leading silence is implied.
+                return;
+
+            ChordTimelineEntry entry;
+            entry.tick = (juce::uint32)tick;
+            entry.pitchClasses = pitchClasses.mask;
+            if (! pitchClasses.isEmpty())
+            {
+                const auto match = ChordIdentificationTable::getInstance().lookup(pitchClasses, bassNote);
+                entry.rootAndBass = (juce::uint8)((match.root & 0x0f) | (match.bass & 0x0f) << 4);
+                entry.quality = (juce::int8)match.quality;
+            }
+
+            if (! timeline.isEmpty())
+            {
+                const auto& last = timeline.getReference(timeline.size() - 1);
+                if (last.pitchClasses == entry.pitchClasses && last.rootAndBass == entry.rootAndBass && last.quality == entry.quality)
+                    return;
+            }
+            timeline.add(entry);
+        }
+
+        Options options;
+        int ticksPerQuarter = 960;
+        int numNoteOns = 0;
+        juce::Array<TrackCursor> tracks;
+        juce::Array<ChordTimelineEntry> timeline;
+
+        juce::uint8 channelNoteCounts[16][128]; // Note-ons not yet released, per channel.
+        juce::uint8 noteCounts[128];            // Channels on which each note sounds.
+        juce::uint64 sounding[2];               // Bit n set while note n sounds.
+
+        juce::int64 currentTick = 0;
+        juce::int64 sliceTicks = 1, currentSlice = 0; // Slicing::beats
+        juce::uint64 sliceNotes[2];                    // Notes sounding at some point of the current slice.
+        juce::int64 onsetWindowTicks = 1, groupTick = -1; // Slicing::onsets; groupTick is -1 between groups.
+        juce::uint64 groupNotes[2];                       // Notes started in the current group.
+        juce::int64 silenceTick = -1;                     // Slicing::onsets: when the last note was released, -1 if sounding.
+        juce::int64 lastReleaseTick = -1;                 // Slicing::onsets: when all notes were last released, even within a group.
+    };
+
+    /**
+        The rhythm of a pattern of up to 64 steps, one bit per step (bit i = step i).
+        Arpeggiator::getRhythmMasks() builds one from a pattern string, following the
+        arpeggiator's step semantics; a Euclidean rhythm is { euclideanMask(hits, steps), 0, steps }.
+    */
+    struct RhythmMasks
+    {
+        juce::uint64 hits = 0;     // Steps that start a note.
+        juce::uint64 sustains = 0; // Steps that hold the previous note ('_').
+        int length = 0;            // Number of steps, 0-64. All other steps are rests.
+
+        bool operator==(const RhythmMasks& other) const
+        {
+            return hits == other.hits && sustains == other.sustains && length == other.length;
+        }
+
+        /** Returns this rhythm with step i moved to step i + rotation, wrapping around its length. */
+        RhythmMasks rotated(int rotation) const
+        {
+            return { rotateSteps(hits, length, rotation), rotateSteps(sustains, length, rotation), length };
+        }
+
+        /**
+            Returns the rotation of this rhythm with the smallest masks, which is the same for
+            every rotation of it. Comparing canonical forms finds rotated copies of a rhythm.
+        */
+        RhythmMasks getCanonical() const
+        {
+            RhythmMasks best = *this;
+            for (int rotation = 1; rotation < length; ++rotation)
+            {
+                const auto candidate = rotated(rotation);
+                if (candidate.hits < best.hits || (candidate.hits == best.hits && candidate.sustains < best.sustains))
+                    best = candidate;
+            }
+            return best;
+        }
+    };
+
+    /**
+        Returns the number of steps on which two rhythms differ, i.e. where one has a hit,
+        sustain or rest and the other does not. Steps beyond a rhythm's length are rests.
+    */
+    static int getRhythmDistance(const RhythmMasks& a, const RhythmMasks& b)
+    {
+        return juce::countNumberOfBits((a.hits ^ b.hits) | (a.sustains ^ b.sustains));
+    }
+
+    /**
+        A library of rhythms searchable by similarity, e.g. for a "find similar rhythms" browser.
+        Masks are kept in flat arrays and queries scan them in blocks with one XOR/OR/popcount
+        per rhythm and rotation, a loop compilers vectorise, split across threads for large
+        libraries. A query over 2 million rhythms takes a few milliseconds for Metric::hamming.
+        Not thread-safe while rhythms are being added; queries may run concurrently.
+    */
+    class RhythmIndex
+    {
+    public:
+        enum class Metric
+        {
+            hamming, // getRhythmDistance() to the query as given.
+            rotation // The smallest getRhythmDistance() over all rotations of the query.
+        };
+
+        struct Match
+        {
+            int index = -1;    // As returned by add().
+            int distance = 0;  // In steps, see Metric.
+        };
+
+        void reserve(int numRhythms)
+        {
+            for (auto* masks : { &hits, &sustains, &canonicalHits, &canonicalSustains })
+                masks->reserve((size_t)numRhythms);
+            lengths.reserve((size_t)numRhythms);
+        }
+
+        /** Adds a rhythm and returns its index. */
+        int add(const RhythmMasks& rhythm)
+        {
+            const auto canonical = rhythm.getCanonical();
+            hits.push_back(rhythm.hits);
+            sustains.push_back(rhythm.sustains);
+            lengths.push_back((juce::uint8)juce::jlimit(0, 64, rhythm.length));
+            canonicalHits.push_back(canonical.hits);
+            canonicalSustains.push_back(canonical.sustains);
+            return size() - 1;
+        }
+
+        void clear()
+        {
+            for (auto* masks : { &hits, &sustains, &canonicalHits, &canonicalSustains })
+                masks->clear();
+            lengths.clear();
+        }
+
+        int size() const { return (int)hits.size(); }
+
+        RhythmMasks get(int index) const
+        {
+            jassert(juce::isPositiveAndBelow(index, size()));
+            return { hits[(size_t)index], sustains[(size_t)index], lengths[(size_t)index] };
+        }
+
+        /** Returns the indices of every rhythm that is a rotation of the query (including itself), in order. */
+        juce::Array<int> findRotationsOf(const RhythmMasks& query) const
+        {
+            const auto canonical = query.getCanonical();
+            juce::Array<int> found;
+            for (int i = 0; i < size(); ++i)
+                if (canonicalHits[(size_t)i] == canonical.hits && canonicalSustains[(size_t)i] == canonical.sustains
+                    && lengths[(size_t)i] == query.length)
+                    found.add(i);
+            return found;
+        }
+
+        /**
+            Returns the k rhythms closest to the query, closest first; equal distances are
+            ordered by index.
+            @param numThreads The number of threads to scan with; 0 uses every core for large libraries.
+        */
+        juce::Array<Match> findNearest(const RhythmMasks& query, int k, Metric metric = Metric::hamming, int numThreads = 0) const
+        {
+            juce::Array<Match> result;
+            k = juce::jmin(k, size());
+            if (k <= 0)
+                return result;
+
+            // The query's rotations, so a scan only needs XOR, OR and popcount.
+            // A query built by hand may claim more steps than the masks hold.
+            jassert(query.length >= 0 && query.length <= 64);
+            RhythmMasks rotations[64];
+            const int numRotations = metric == Metric::rotation ? juce::jlimit(1, 64, query.length) : 1;
+            for (int r = 0; r < numRotations; ++r)
+                rotations[r] = query.rotated(r);
+
+            if (numThreads <= 0)
+                numThreads = size() >= minRhythmsPerThread * 2 ? (int)std::thread::hardware_concurrency() : 1;
+            numThreads = juce::jlimit(1, juce::jmax(1, size() / minRhythmsPerThread), numThreads);
+
+            std::vector<std::vector<Match>> nearest((size_t)numThreads);
+            auto scanRange = [&](int thread)
+            {
+                const int begin = (int)((juce::int64)size() * thread / numThreads);
+                const int end = (int)((juce::int64)size() * (thread + 1) / numThreads);
+                nearest[(size_t)thread] = scan(rotations, numRotations, begin, end, k);
+            };
+
+            std::vector<std::thread> threads;
+            for (int thread = 1; thread < numThreads; ++thread)
+                threads.emplace_back(scanRange, thread);
+            scanRange(0);
+            for (auto& thread : threads)
+                thread.join();
+
+            std::vector<Match> merged;
+            for (const auto& matches : nearest)
+                merged.insert(merged.end(), matches.begin(), matches.end());
+            std::sort(merged.begin(), merged.end(), isCloser);
+
+            result.ensureStorageAllocated(k);
+            for (int i = 0; i < k; ++i)
+                result.add(merged[(size_t)i]);
+            return result;
+        }
+
+    private:
+        static constexpr int minRhythmsPerThread = 1 << 16;
+        static constexpr int blockSize = 256;
+
+        static bool isCloser(const Match& a, const Match& b)
+        {
+            return a.distance < b.distance || (a.distance == b.distance && a.index < b.index);
+        }
+
+        /** Returns the k closest rhythms in [begin, end), in no particular order. */
+        std::vector<Match> scan(const RhythmMasks* rotations, int numRotations, int begin, int end, int k) const
+        {
+            std::vector<Match> heap; // Max-heap on isCloser(): the farthest kept match is at the front.
+            heap.reserve((size_t)k);
+            int distances[blockSize];
+
+            for (int blockStart = begin; blockStart < end; blockStart += blockSize)
+            {
+                const int count = juce::jmin(blockSize, end - blockStart);
+                const juce::uint64* blockHits = hits.data() + blockStart;
+                const juce::uint64* blockSustains = sustains.data() + blockStart;
+
+                for (int i = 0; i < count; ++i)
+                    distances[i] = 64;
+                for (int r = 0; r < numRotations; ++r)
+                {
+                    const auto queryHits = rotations[r].hits;
+                    const auto querySustains = rotations[r].sustains;
+                    for (int i = 0; i < count; ++i)
+                    {
+                        const int distance = juce::countNumberOfBits((blockHits[i] ^ queryHits) | (blockSustains[i] ^ querySustains));
+                        distances[i] = distance < distances[i] ? distance : distances[i];
+                    }
+                }
+
+                for (int i = 0; i < count; ++i)
+                {
+                    const Match match { blockStart + i, distances[i] };
+                    if ((int)heap.size() < k)
+                    {
+                        heap.push_back(match);
+                        std::push_heap(heap.begin(), heap.end(), isCloser);
+                    }
+                    else if (isCloser(match, heap.front()))
+                    {
+                        std::pop_heap(heap.begin(), heap.end(), isCloser);
+                        heap.back() = match;
+                        std::push_heap(heap.begin(), heap.end(), isCloser);
+                    }
+                }
+            }
+            return heap;
+        }
+
+        // One entry per rhythm in each array.
+        std::vector<juce::uint64> hits, sustains;
+        std::vector<juce::uint64> canonicalHits, canonicalSustains;
+        std::vector<juce::uint8> lengths;
+    };
 }